@@ -7,20 +7,64 @@
 #define OPENCL_UINT uint
 #define OPENCL_FLOAT float
 #else
-#include <gl_libs.h>
+#include <cl_libs.h>
 #define STRUCT_ATTRIBUTE_PACKED  
 #define OPENCL_FLOAT3 cl_float3
 #define OPENCL_FLOAT cl_float
 #define OPENCL_UINT cl_uint
 #endif
 
+// neighbor search modes (see sim::Neighbor_Search)
+#define NEIGHBOR_SEARCH_GRID 0
+#define NEIGHBOR_SEARCH_NEIGHBOR_LIST 1
+#define NEIGHBOR_SEARCH_CELL_RANGES 2
+
+// grid types (see sim::Grid_Type)
+#define GRID_TYPE_HASHED 0
+#define GRID_TYPE_DENSE 1
+
+// cell orderings (see sim::Cell_Ordering)
+#define CELL_ORDERING_LINEAR 0
+#define CELL_ORDERING_MORTON 1
+
+// fusion of the PCISPH prediction (see sim::Kernel_Fusion)
+#define KERNEL_FUSION_NONE 0
+#define KERNEL_FUSION_PREDICT_WITH_FORCES 1
+#define KERNEL_FUSION_PREDICT_ON_THE_FLY 2
+
+// memory layout of the particle vectors (positions, velocities, forces, normals), selected at compile time 
+// with -DPARTICLE_LAYOUT=<n> (the host passes its layout to the OpenCL programs)
+// -> float3 values packed with a 12 byte stride
+#define PARTICLE_LAYOUT_PACKED 0
+// -> float4 values (w unused) with a 16 byte stride for aligned vector loads
+#define PARTICLE_LAYOUT_FLOAT4 1
+// -> structure of arrays: all x, then all y, then all z values
+#define PARTICLE_LAYOUT_SOA 2
+
+#ifndef PARTICLE_LAYOUT
+#define PARTICLE_LAYOUT PARTICLE_LAYOUT_PACKED
+#endif
+
+// the compressed storage (-DCOMPRESSED_STORAGE, see sim::Fluid::set_compressed_storage) replaces the packed layout:
+// positions as 16 bit fixed point values and all other particle vectors as half
+
+// floats per particle in a particle vector buffer (uncompressed)
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_FLOAT4
+#define PARTICLE_VEC_FLOATS 4
+#else
+#define PARTICLE_VEC_FLOATS 3
+#endif
+
 #pragma pack(push, 1)
 typedef struct STRUCT_ATTRIBUTE_PACKED {
 	OPENCL_FLOAT particle_radius;
 	OPENCL_FLOAT particle_mass;
 	OPENCL_FLOAT rest_density;
 	OPENCL_UINT boundary_count;
+	// active fluid particles (at the front of the fluid buffers). changes on the device if particles are emitted or removed
 	OPENCL_UINT fluid_count;
+	// particles the fluid buffers can hold (plane size of the SoA layout)
+	OPENCL_UINT fluid_capacity;
 
 	OPENCL_FLOAT kernel_radius;
 	OPENCL_FLOAT kernel_radius2;
@@ -28,6 +72,22 @@ typedef struct STRUCT_ATTRIBUTE_PACKED {
 	OPENCL_UINT bucket_count;
 	OPENCL_FLOAT cell_size;
 
+	// dense grid: the cells are indexed linearly inside [grid_origin, grid_origin + grid_resolution * cell_size]
+	OPENCL_UINT grid_type;
+	OPENCL_FLOAT grid_origin_x;
+	OPENCL_FLOAT grid_origin_y;
+	OPENCL_FLOAT grid_origin_z;
+	OPENCL_UINT grid_resolution_x;
+	OPENCL_UINT grid_resolution_y;
+	OPENCL_UINT grid_resolution_z;
+	OPENCL_UINT cell_ordering;
+
+	// compressed storage: positions are stored as 16 bit fixed point values (position - position_origin) * position_scale
+	OPENCL_FLOAT position_origin_x;
+	OPENCL_FLOAT position_origin_y;
+	OPENCL_FLOAT position_origin_z;
+	OPENCL_FLOAT position_scale;
+
 	OPENCL_FLOAT poly6_normalization;
 	OPENCL_FLOAT poly6_d1_normalization;
 	OPENCL_FLOAT viscosity_d2_normalization;
@@ -41,6 +101,9 @@ typedef struct STRUCT_ATTRIBUTE_PACKED {
 	OPENCL_FLOAT delta_t;
 
 	OPENCL_FLOAT density_variation_scaling_factor;
+
+	OPENCL_UINT neighbor_search;
+	OPENCL_UINT kernel_fusion;
 } Simulation_Params;
 #pragma pack(pop)
 
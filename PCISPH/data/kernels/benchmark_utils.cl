@@ -0,0 +1,17 @@
+#ifndef BENCHMARK_UTILS_H
+#define BENCHMARK_UTILS_H
+
+#include <data/kernels/Simulation_Params.h>
+#include <data/kernels/grid_utils.cl>
+
+// reads two particle vectors and writes one (the access pattern of the time integration) to measure the
+// bandwidth of the particle vector layout
+__kernel void stream_particle_vectors(uint count, __global float* in_positions, __global float* in_velocities, __global float* out_positions) {
+	if(get_global_id(0) >= count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 pos = LOAD_PARTICLE_VEC(self_id, in_positions, count) + 0.001f * LOAD_PARTICLE_VEC(self_id, in_velocities, count);
+	STORE_PARTICLE_VEC(pos, self_id, out_positions, count);
+}
+
+#endif
@@ -1,6 +1,78 @@
 #ifndef GRID_UTILS_H
 #define GRID_UTILS_H
 
+#include <data/kernels/Simulation_Params.h>
+
+// specialized programs (see sim::Fluid::set_program_specialization): the parameters which are fixed for a run are 
+// compiled in as constants (-DCONST_PARAM_<name>=<value>) and unused features are removed (-DFEATURE_<name>=0)
+#if defined(SPECIALIZED_PARAMS)
+#define CONST_PARAM(params, name) (CONST_PARAM_##name)
+#else
+#define CONST_PARAM(params, name) ((params)->name)
+#endif
+// -> the physical constants (mass, rest density, viscosity, surface tension, gravity) stay in the parameter buffer once they
+//    are changed during a simulation (-DSTEERED_PARAMS), the program is not rebuilt for every new value
+#if defined(SPECIALIZED_PARAMS) && !defined(STEERED_PARAMS)
+#define PHYSICAL_PARAM(params, name) (CONST_PARAM_##name)
+#else
+#define PHYSICAL_PARAM(params, name) ((params)->name)
+#endif
+
+#ifndef FEATURE_BOUNDARY
+#define FEATURE_BOUNDARY 1
+#endif
+#ifndef FEATURE_GRAVITY
+#define FEATURE_GRAVITY 1
+#endif
+#ifndef FEATURE_VISCOSITY
+#define FEATURE_VISCOSITY 1
+#endif
+#ifndef FEATURE_SURFACE_TENSION
+#define FEATURE_SURFACE_TENSION 1
+#endif
+
+// compressed storage: positions as 16 bit fixed point values inside the position domain
+inline float3 dequantize_position(__constant Simulation_Params* params, ushort3 value) {
+	const float3 origin = (float3)(params->position_origin_x, params->position_origin_y, params->position_origin_z);
+	return origin + convert_float3(value) / params->position_scale;
+}
+inline ushort3 quantize_position(__constant Simulation_Params* params, float3 pos) {
+	const float3 origin = (float3)(params->position_origin_x, params->position_origin_y, params->position_origin_z);
+	return convert_ushort3_sat_rte((pos - origin) * params->position_scale);
+}
+
+// particle vector accessors (see PARTICLE_LAYOUT), count is the number of particles the buffer can hold (SoA plane size,
+// params->fluid_capacity for the fluid buffers).
+// positions use the *_PARTICLE_POS variants, COPY_PARTICLE_VEC copies a vector without converting it
+#if defined(COMPRESSED_STORAGE)
+#define LOAD_PARTICLE_VEC(i, buffer, count) vload_half3((i), (__global half*)(buffer))
+#define STORE_PARTICLE_VEC(value, i, buffer, count) vstore_half3((value), (i), (__global half*)(buffer))
+#define LOAD_PARTICLE_POS(params, i, buffer, count) dequantize_position((params), vload3((i), (__global ushort*)(buffer)))
+#define STORE_PARTICLE_POS(params, value, i, buffer, count) vstore3(quantize_position((params), (value)), (i), (__global ushort*)(buffer))
+#define COPY_PARTICLE_VEC(src_i, in_buffer, dst_i, out_buffer, count) vstore3(vload3((src_i), (__global ushort*)(in_buffer)), (dst_i), (__global ushort*)(out_buffer))
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_FLOAT4
+#define LOAD_PARTICLE_VEC(i, buffer, count) (vload4((i), (buffer)).xyz)
+#define STORE_PARTICLE_VEC(value, i, buffer, count) vstore4((float4)((value), 0.f), (i), (buffer))
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+#define LOAD_PARTICLE_VEC(i, buffer, count) ((float3)((buffer)[(i)], (buffer)[(count) + (i)], (buffer)[2 * (count) + (i)]))
+#define STORE_PARTICLE_VEC(value, i, buffer, count) \
+{ \
+	const float3 stored_value = (value); \
+	(buffer)[(i)] = stored_value.x; \
+	(buffer)[(count) + (i)] = stored_value.y; \
+	(buffer)[2 * (count) + (i)] = stored_value.z; \
+}
+#else
+#define LOAD_PARTICLE_VEC(i, buffer, count) vload3((i), (buffer))
+#define STORE_PARTICLE_VEC(value, i, buffer, count) vstore3((value), (i), (buffer))
+#endif
+
+#if !defined(COMPRESSED_STORAGE)
+#define LOAD_PARTICLE_POS(params, i, buffer, count) LOAD_PARTICLE_VEC(i, buffer, count)
+#define STORE_PARTICLE_POS(params, value, i, buffer, count) STORE_PARTICLE_VEC(value, i, buffer, count)
+#define COPY_PARTICLE_VEC(src_i, in_buffer, dst_i, out_buffer, count) STORE_PARTICLE_VEC(LOAD_PARTICLE_VEC(src_i, in_buffer, count), dst_i, out_buffer, count)
+#endif
+
 // 0 = conservative with checks for duplicate cell hashs
 // 1 = no checks for duplicates because the hash should be unique in local neighborhood
 #define NEIGHBOR_SEARCH_METHOD 1
@@ -27,6 +99,51 @@ inline uint get_hash_key(int3 cell_pos, uint bucket_count) {
 #endif
 }
 
+// grid (hashed or dense depending on CONST_PARAM(params, grid_type))
+// -> dense grid: positions outside of the grid are clamped to the border cells
+inline int3 get_grid_cell_pos(__constant Simulation_Params* params, float3 pos) {
+	if(CONST_PARAM(params, grid_type) != GRID_TYPE_DENSE)
+		return get_cell_pos(pos, CONST_PARAM(params, cell_size));
+
+	const float3 origin = (float3)(CONST_PARAM(params, grid_origin_x), CONST_PARAM(params, grid_origin_y), CONST_PARAM(params, grid_origin_z));
+	const int3 resolution = (int3)(CONST_PARAM(params, grid_resolution_x), CONST_PARAM(params, grid_resolution_y), CONST_PARAM(params, grid_resolution_z));
+	return clamp(get_cell_pos(pos - origin, CONST_PARAM(params, cell_size)), (int3)(0, 0, 0), resolution - 1);
+}
+// -> neighbor cells outside of the dense grid don't exist
+inline bool is_cell_in_grid(__constant Simulation_Params* params, int3 cell_pos) {
+	if(CONST_PARAM(params, grid_type) != GRID_TYPE_DENSE)
+		return true;
+
+	return cell_pos.x >= 0 && cell_pos.y >= 0 && cell_pos.z >= 0 &&
+		cell_pos.x < (int) CONST_PARAM(params, grid_resolution_x) && cell_pos.y < (int) CONST_PARAM(params, grid_resolution_y) && cell_pos.z < (int) CONST_PARAM(params, grid_resolution_z);
+}
+// z-order curve: interleaves the lower 10 bits of every coordinate
+inline uint expand_morton_bits(uint v) {
+	v &= 0x3FF;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+inline uint get_morton_code(int3 cell_pos) {
+	return expand_morton_bits((uint) cell_pos.x) | (expand_morton_bits((uint) cell_pos.y) << 1) | (expand_morton_bits((uint) cell_pos.z) << 2);
+}
+// -> morton ordering: neighboring cells get nearby keys, so the 3x3x3 neighborhood mostly lies in a few contiguous ranges.
+//    the hashed grid stays locally unique because the lowest 6 bits of the morton code are unique in every 4x4x4 block
+//    and the bucket count is a multiple of 64
+inline uint get_cell_key(__constant Simulation_Params* params, int3 cell_pos) {
+	if(CONST_PARAM(params, cell_ordering) == CELL_ORDERING_MORTON) {
+		const uint morton_code = get_morton_code(cell_pos);
+		return CONST_PARAM(params, grid_type) == GRID_TYPE_DENSE ? morton_code : morton_code % CONST_PARAM(params, bucket_count);
+	}
+
+	if(CONST_PARAM(params, grid_type) != GRID_TYPE_DENSE)
+		return get_hash_key(cell_pos, CONST_PARAM(params, bucket_count));
+
+	return cell_pos.x + CONST_PARAM(params, grid_resolution_x) * (cell_pos.y + CONST_PARAM(params, grid_resolution_y) * cell_pos.z);
+}
+
 void get_cell_start_end_offset(__global uint* cell_offsets, uint hash_key, uint bucket_count, uint* out_start, uint* out_end) {
 	uint2 data = vload2(hash_key, cell_offsets);
 	*out_start = data.x;
@@ -38,11 +155,13 @@ void get_cell_start_end_offset(__global uint* cell_offsets, uint hash_key, uint
 { \
 	uint processed_hash_key_count = 0; \
 	uint processed_hash_keys[3 * 3 * 3]; \
-	int3 cell_pos = get_cell_pos(pos, params->cell_size); \
+	int3 cell_pos = get_grid_cell_pos(params, pos); \
 	for(int i = 0; i < 3 * 3 * 3; i++) { \
 		int3 offset = { (i / 1) % 3 - 1, (i / 3) % 3 - 1, (i / 9) % 3 - 1 }; \
 		int3 cur_cell_pos = cell_pos + offset; \
-		uint hash_key = get_hash_key(cur_cell_pos, params->bucket_count); \
+		if(!is_cell_in_grid(params, cur_cell_pos)) \
+			continue; \
+		uint hash_key = get_cell_key(params, cur_cell_pos); \
 		bool skip = false; \
 		for(uint j = 0; j < processed_hash_key_count; j++) { \
 			if(hash_key == processed_hash_keys[j]) { \
@@ -55,7 +174,7 @@ void get_cell_start_end_offset(__global uint* cell_offsets, uint hash_key, uint
 		processed_hash_keys[processed_hash_key_count++] = hash_key; \
 		uint start = 0; \
 		uint end = 0; \
-		get_cell_start_end_offset(cell_offsets, hash_key, params->bucket_count, &start, &end); \
+		get_cell_start_end_offset(cell_offsets, hash_key, CONST_PARAM(params, bucket_count), &start, &end); \
 		for(uint other_id = start; other_id < end; other_id++) { \
 			FOREACH_NEIGHBOR_BODY; \
 		} \
@@ -64,14 +183,16 @@ void get_cell_start_end_offset(__global uint* cell_offsets, uint hash_key, uint
 #elif NEIGHBOR_SEARCH_METHOD == 1
 #define FOREACH_NEIGHBOR(params, cell_offsets, pos, FOREACH_NEIGHBOR_BODY) \
 { \
-	int3 cell_pos = get_cell_pos(pos, params->cell_size); \
+	int3 cell_pos = get_grid_cell_pos(params, pos); \
 	for(int i = 0; i < 3 * 3 * 3; i++) { \
 		int3 offset = { ((i / 1) % 3) - 1, ((i / 3) % 3) - 1, ((i / 9) % 3) - 1 }; \
 		int3 cur_cell_pos = cell_pos + offset; \
-		uint hash_key = get_hash_key(cur_cell_pos, params->bucket_count); \
+		if(!is_cell_in_grid(params, cur_cell_pos)) \
+			continue; \
+		uint hash_key = get_cell_key(params, cur_cell_pos); \
 		uint start = 0; \
 		uint end = 0; \
-		get_cell_start_end_offset(cell_offsets, hash_key, params->bucket_count, &start, &end); \
+		get_cell_start_end_offset(cell_offsets, hash_key, CONST_PARAM(params, bucket_count), &start, &end); \
 		for(uint other_id = start; other_id < end; other_id++) { \
 			FOREACH_NEIGHBOR_BODY; \
 		} \
@@ -79,4 +200,150 @@ void get_cell_start_end_offset(__global uint* cell_offsets, uint hash_key, uint
 }
 #endif
 
+// neighbor lists: NEIGHBOR_LIST_SIZE uints per fluid particle, the first one is the neighbor count
+// (set by the host) or NEIGHBOR_LIST_OVERFLOW if the neighbors didn't fit
+#ifndef NEIGHBOR_LIST_SIZE
+#define NEIGHBOR_LIST_SIZE 64
+#endif
+#define NEIGHBOR_LIST_OVERFLOW 0xFFFFFFFF
+
+#define FOREACH_LISTED_NEIGHBOR(neighbor_lists, self_id, FOREACH_NEIGHBOR_BODY) \
+{ \
+	__global uint* neighbor_list = neighbor_lists + (self_id) * NEIGHBOR_LIST_SIZE; \
+	const uint neighbor_count = neighbor_list[0]; \
+	for(uint neighbor_i = 1; neighbor_i <= neighbor_count; neighbor_i++) { \
+		const uint other_id = neighbor_list[neighbor_i]; \
+		FOREACH_NEIGHBOR_BODY; \
+	} \
+}
+
+// cell ranges: the (start, end) offsets of the 27 neighbor cells per fluid particle
+#define FOREACH_CACHED_CELL_RANGE_NEIGHBOR(cell_ranges, self_id, FOREACH_NEIGHBOR_BODY) \
+{ \
+	__global uint* self_cell_ranges = cell_ranges + (self_id) * 2 * 3 * 3 * 3; \
+	for(int i = 0; i < 3 * 3 * 3; i++) { \
+		const uint2 range = vload2(i, self_cell_ranges); \
+		for(uint other_id = range.x; other_id < range.y; other_id++) { \
+			FOREACH_NEIGHBOR_BODY; \
+		} \
+	} \
+}
+
+// uses the neighbor cache (neighbor lists or cell ranges, depending on CONST_PARAM(params, neighbor_search)) if it is bound 
+// and searches the grid otherwise (also for a particle with an overflowed neighbor list)
+#define FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, neighbor_cache, cell_offsets, self_id, pos, FOREACH_NEIGHBOR_BODY) \
+{ \
+	if(neighbor_cache == 0x0) \
+		FOREACH_NEIGHBOR(params, cell_offsets, pos, FOREACH_NEIGHBOR_BODY) \
+	else if(CONST_PARAM(params, neighbor_search) == NEIGHBOR_SEARCH_CELL_RANGES) \
+		FOREACH_CACHED_CELL_RANGE_NEIGHBOR(neighbor_cache, self_id, FOREACH_NEIGHBOR_BODY) \
+	else if(neighbor_cache[(self_id) * NEIGHBOR_LIST_SIZE] == NEIGHBOR_LIST_OVERFLOW) \
+		FOREACH_NEIGHBOR(params, cell_offsets, pos, FOREACH_NEIGHBOR_BODY) \
+	else \
+		FOREACH_LISTED_NEIGHBOR(neighbor_cache, self_id, FOREACH_NEIGHBOR_BODY) \
+}
+
+// half shell: the own cell (only the particles after self_id) and the 13 neighbor cells with a positive offset index,
+// every pair of particles is visited once (the 13 other cells have the mirrored offsets)
+#define FOREACH_HALF_SHELL_NEIGHBOR(params, cell_offsets, self_id, pos, FOREACH_NEIGHBOR_BODY) \
+{ \
+	int3 cell_pos = get_grid_cell_pos(params, pos); \
+	for(int i = (3 * 3 * 3) / 2; i < 3 * 3 * 3; i++) { \
+		int3 offset = { ((i / 1) % 3) - 1, ((i / 3) % 3) - 1, ((i / 9) % 3) - 1 }; \
+		int3 cur_cell_pos = cell_pos + offset; \
+		if(!is_cell_in_grid(params, cur_cell_pos)) \
+			continue; \
+		uint hash_key = get_cell_key(params, cur_cell_pos); \
+		uint start = 0; \
+		uint end = 0; \
+		get_cell_start_end_offset(cell_offsets, hash_key, CONST_PARAM(params, bucket_count), &start, &end); \
+		if(i == (3 * 3 * 3) / 2) \
+			start = max(start, (self_id) + 1); \
+		for(uint other_id = start; other_id < end; other_id++) { \
+			FOREACH_NEIGHBOR_BODY; \
+		} \
+	} \
+}
+
+// every fluid pair once (symmetric) or every fluid neighbor except the particle itself. the neighbor caches
+// store the complete neighborhood, the pairs are visited from the particle with the smaller id
+#define FOREACH_FLUID_PAIR(params, neighbor_cache, cell_offsets, symmetric, self_id, pos, FOREACH_NEIGHBOR_BODY) \
+{ \
+	if(symmetric && neighbor_cache == 0x0) \
+		FOREACH_HALF_SHELL_NEIGHBOR(params, cell_offsets, self_id, pos, FOREACH_NEIGHBOR_BODY) \
+	else \
+		FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, neighbor_cache, cell_offsets, self_id, pos, { \
+			if(symmetric ? other_id > (self_id) : other_id != (self_id)) \
+				FOREACH_NEIGHBOR_BODY; \
+		}) \
+}
+
+// work-group per cell (see sim::Work_Distribution): occupied_cells = (cell count, start of every occupied cell, fluid count).
+// the work-groups loop over the occupied cells, the particles of a cell are processed in chunks of get_local_size(0).
+// all work-items of the group run the body (barriers), is_active is false for the work-items without a particle
+#define FOREACH_OCCUPIED_CELL_CHUNK(params, occupied_cells, fluid_positions, FOREACH_CHUNK_BODY) \
+{ \
+	const uint occupied_cell_count = occupied_cells[0]; \
+	for(uint cell_i = get_group_id(0); cell_i < occupied_cell_count; cell_i += get_num_groups(0)) { \
+		const uint cell_start = occupied_cells[1 + cell_i]; \
+		const uint cell_end = occupied_cells[2 + cell_i]; \
+		const int3 cell_pos = get_grid_cell_pos(params, LOAD_PARTICLE_POS(params, cell_start, fluid_positions, params->fluid_capacity)); \
+		for(uint chunk_start = cell_start; chunk_start < cell_end; chunk_start += get_local_size(0)) { \
+			const uint self_id = chunk_start + get_local_id(0); \
+			const bool is_active = self_id < cell_end; \
+			FOREACH_CHUNK_BODY; \
+		} \
+	} \
+}
+
+// loads the particles of the 27 neighbor cells of cell_pos in tiles of get_local_size(0) entries into local memory.
+// tile_cells (2 * 27 + 1 uints) holds the start and the exclusive prefix sum of every neighbor cell and the neighbor count.
+// LOAD_TILE_ENTRY stores the data of other_id at tile_slot, FOREACH_NEIGHBOR_BODY reads the entry at tile_slot and is 
+// only run by the work-items with is_tiled. has to be reached by all work-items of the group, needs a local size >= 27
+#define FOREACH_TILED_NEIGHBOR(params, cell_offsets, cell_pos, tile_cells, is_tiled, LOAD_TILE_ENTRY, FOREACH_NEIGHBOR_BODY) \
+{ \
+	const uint local_id = get_local_id(0); \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	if(local_id < 3 * 3 * 3) { \
+		const int3 offset = { ((local_id / 1) % 3) - 1, ((local_id / 3) % 3) - 1, ((local_id / 9) % 3) - 1 }; \
+		const int3 cur_cell_pos = (cell_pos) + offset; \
+		uint2 range = (uint2)(0, 0); \
+		if(cell_offsets != 0x0 && is_cell_in_grid(params, cur_cell_pos)) \
+			range = vload2(get_cell_key(params, cur_cell_pos), cell_offsets); \
+		tile_cells[2 * local_id] = range.x; \
+		tile_cells[2 * local_id + 1] = range.y - range.x; \
+	} \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	if(local_id == 0) { \
+		uint neighbor_count = 0; \
+		for(int i = 0; i < 3 * 3 * 3; i++) { \
+			const uint cell_count = tile_cells[2 * i + 1]; \
+			tile_cells[2 * i + 1] = neighbor_count; \
+			neighbor_count += cell_count; \
+		} \
+		tile_cells[2 * 3 * 3 * 3] = neighbor_count; \
+	} \
+	barrier(CLK_LOCAL_MEM_FENCE); \
+	const uint tile_neighbor_count = tile_cells[2 * 3 * 3 * 3]; \
+	for(uint tile_start = 0; tile_start < tile_neighbor_count; tile_start += get_local_size(0)) { \
+		if(tile_start + local_id < tile_neighbor_count) { \
+			const uint tile_i = tile_start + local_id; \
+			int tile_cell_i = 0; \
+			while(tile_cell_i < 3 * 3 * 3 - 1 && tile_cells[2 * (tile_cell_i + 1) + 1] <= tile_i) \
+				tile_cell_i++; \
+			const uint other_id = tile_cells[2 * tile_cell_i] + tile_i - tile_cells[2 * tile_cell_i + 1]; \
+			const uint tile_slot = local_id; \
+			LOAD_TILE_ENTRY; \
+		} \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if(is_tiled) { \
+			const uint tile_size = min((uint) get_local_size(0), tile_neighbor_count - tile_start); \
+			for(uint tile_slot = 0; tile_slot < tile_size; tile_slot++) { \
+				FOREACH_NEIGHBOR_BODY; \
+			} \
+		} \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	} \
+}
+
 #endif
\ No newline at end of file
@@ -61,95 +61,166 @@ inline float kernel_surface_tension(float r, float h, float st_term) {
 }
 		
 
+// on-device convergence check (Fluid::advance)
+// solver_state[0] = converged flag, solver_state[1] = finished iterations of the current step
+inline bool is_solver_converged(__global uint* solver_state) {
+	return solver_state != 0x0 && solver_state[0] != 0;
+}
+
+// predicted position of the current PCISPH iteration (same integration as update_position_and_velocity)
+inline float3 predict_position(__constant Simulation_Params* params, float3 pos, float3 vel, float3 force) {
+	const float3 predicted_vel = vel + force / PHYSICAL_PARAM(params, particle_mass) * params->delta_t;
+	return pos + predicted_vel * params->delta_t;
+}
+
+// KERNEL_FUSION_PREDICT_ON_THE_FLY: there is no prediction pass, the positions are predicted from the velocities and forces
+inline float3 load_predicted_position(__constant Simulation_Params* params, uint id, __global float* fluid_positions, __global float* fluid_predicted_positions,
+                                      __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_pressure_forces) {
+	if(CONST_PARAM(params, kernel_fusion) != KERNEL_FUSION_PREDICT_ON_THE_FLY)
+		return LOAD_PARTICLE_POS(params, id, fluid_predicted_positions, params->fluid_capacity);
+
+	const float3 force = LOAD_PARTICLE_VEC(id, fluid_other_forces, params->fluid_capacity) + LOAD_PARTICLE_VEC(id, fluid_pressure_forces, params->fluid_capacity);
+	return predict_position(params, LOAD_PARTICLE_POS(params, id, fluid_positions, params->fluid_capacity), LOAD_PARTICLE_VEC(id, fluid_velocities, params->fluid_capacity), force);
+}
+
+// gravity force of a particle
+inline float3 gravity_force(__constant Simulation_Params* params) {
+	if(!FEATURE_GRAVITY)
+		return (float3) (0.f, 0.f, 0.f);
+	return (float3) (0.f, PHYSICAL_PARAM(params, particle_mass) * PHYSICAL_PARAM(params, gravity), 0.f);
+}
+
+// symmetric pair evaluation: the forces are accumulated in pair_forces (packed float3, independent of the particle layout)
+// -> float atomics with a compare and exchange loop (32 bit global atomics are core in OpenCL 1.1)
+inline void atomic_add_float(volatile __global float* address, float value) {
+	union { uint u; float f; } old_value, new_value;
+	do {
+		old_value.f = *address;
+		new_value.f = old_value.f + value;
+	} while(atomic_cmpxchg((volatile __global uint*) address, old_value.u, new_value.u) != old_value.u);
+}
+inline void atomic_add_pair_force(__global float* pair_forces, uint id, float3 force) {
+	atomic_add_float(pair_forces + 3 * id + 0, force.x);
+	atomic_add_float(pair_forces + 3 * id + 1, force.y);
+	atomic_add_float(pair_forces + 3 * id + 2, force.z);
+}
+// -> the partner gets the opposite force, the particle adds the sum of its pairs once.
+//    otherwise only the own side is evaluated (every neighbor) and stored
+inline void store_pair_force(__global float* pair_forces, uint symmetric, uint self_id, float3 force) {
+	if(symmetric)
+		atomic_add_pair_force(pair_forces, self_id, force);
+	else
+		vstore3(force, self_id, pair_forces);
+}
+
 // OpenCL kernels
 __kernel void update_density(__constant Simulation_Params* params, 
-                             __global uint* boundary_cell_offsets, __global float* boundary_positions,
-                             __global uint* fluid_cell_offsets, __global float* fluid_positions, __global float* fluid_densitites) {
+                             __global uint* boundary_cell_offsets, __global uint* boundary_neighbor_cache, __global float* boundary_positions,
+                             __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache, __global float* fluid_positions, __global float* fluid_densitites) {
 	if(get_global_id(0) >= params->fluid_count) return;
 
 	const uint self_id = get_global_id(0);
-	const float3 self_pos = vload3(self_id, fluid_positions);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
 	
 	float density = 0.f;
 
 	// boundary neighbors
-	FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
-		float3 other_pos = vload3(other_id, boundary_positions);
+	if(FEATURE_BOUNDARY) FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, boundary_neighbor_cache, boundary_cell_offsets, self_id, self_pos, {
+		float3 other_pos = LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
 		float3 diff = self_pos - other_pos;
 		float r2 = dot(diff, diff);
-		density += kernel_poly6(r2, params->kernel_radius2);
+		density += kernel_poly6(r2, CONST_PARAM(params, kernel_radius2));
 	});
 
 	// fluid neighbors
-	FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
-		float3 other_pos = vload3(other_id, fluid_positions);
+	FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, fluid_neighbor_cache, fluid_cell_offsets, self_id, self_pos, {
+		float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
 		float3 diff = self_pos - other_pos;
 		float r2 = dot(diff, diff);
-		density += kernel_poly6(r2, params->kernel_radius2);
+		density += kernel_poly6(r2, CONST_PARAM(params, kernel_radius2));
 	});
-	density *= params->particle_mass * params->poly6_normalization;
+	density *= PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, poly6_normalization);
 	fluid_densitites[self_id] = density;
 }
 
 __kernel void update_normal(__constant Simulation_Params* params, 
-                            __global uint* fluid_cell_offsets, __global float* fluid_positions, __global float* fluid_densitites, __global float* fluid_normals) {
+                            __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache, __global float* fluid_positions, __global float* fluid_densitites, __global float* fluid_normals) {
 	if(get_global_id(0) >= params->fluid_count) return;
 
 	const uint self_id = get_global_id(0);
-	const float3 self_pos = vload3(self_id, fluid_positions);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
 	
 	float3 normal = (float3)(0.f, 0.f, 0.f);
-	FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
-		const float3 other_pos = vload3(other_id, fluid_positions);
+	FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, fluid_neighbor_cache, fluid_cell_offsets, self_id, self_pos, {
+		const float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
 		const float other_density = fluid_densitites[other_id];
 		const float3 diff = self_pos - other_pos;
 		
-		normal += kernel_poly6_d1(diff, params->kernel_radius2) / other_density;
+		normal += kernel_poly6_d1(diff, CONST_PARAM(params, kernel_radius2)) / other_density;
 	});
-	normal *= params->kernel_radius * params->particle_mass * params->poly6_d1_normalization;
+	normal *= CONST_PARAM(params, kernel_radius) * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, poly6_d1_normalization);
 	
-	vstore3(normal, self_id, fluid_normals);
+	STORE_PARTICLE_VEC(normal, self_id, fluid_normals, params->fluid_capacity);
+}
+
+// warm start (Fluid::set_pressure_warm_start): the pressures of the previous step scaled by warm_start, 0 starts from zero pressure
+// (the pressures are undefined then)
+inline float initial_pressure(float previous_pressure, float warm_start) {
+	return warm_start > 0.f ? previous_pressure * warm_start : 0.f;
 }
 
-__kernel void boundary_pressure_initialization(__constant Simulation_Params* params, __global float* boundary_pressures) {
+__kernel void boundary_pressure_initialization(__constant Simulation_Params* params, __global float* boundary_pressures, float warm_start) {
 	if(get_global_id(0) >= params->boundary_count) return;
 	
 	const uint self_id = get_global_id(0);
-	boundary_pressures[self_id] = 0.f;
+	boundary_pressures[self_id] = initial_pressure(boundary_pressures[self_id], warm_start);
 }
 
-__kernel void force_initialization(__constant Simulation_Params* params, __global uint* fluid_cell_offsets, 
+__kernel void force_initialization(__constant Simulation_Params* params, __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache,
                                    __global float* fluid_positions, __global float* fluid_normals, __global float* fluid_densitites, __global float* fluid_velocities, 
-                                   __global float* fluid_other_forces, __global float* fluid_pressures, __global float* fluid_pressure_forces) {
+                                   __global float* fluid_other_forces, __global float* fluid_pressures, __global float* fluid_pressure_forces, 
+                                   __global float* fluid_predicted_positions, __global float* pair_forces, float warm_start) {
 	if(get_global_id(0) >= params->fluid_count) return;
 	
 	const uint self_id = get_global_id(0);
-	const float3 self_pos = vload3(self_id, fluid_positions);
-	const float3 self_vel = vload3(self_id, fluid_velocities);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	const float3 self_vel = LOAD_PARTICLE_VEC(self_id, fluid_velocities, params->fluid_capacity);
 	const float self_density = fluid_densitites[self_id];
-	const float3 self_normal = vload3(self_id, fluid_normals);
+	const float3 self_normal = LOAD_PARTICLE_VEC(self_id, fluid_normals, params->fluid_capacity);
+
+	// -> symmetric pair evaluation: the forces were accumulated by accumulate_other_forces (cleared for the next evaluation)
+	if(pair_forces != 0x0) {
+		const float3 other_forces = gravity_force(params) + vload3(self_id, pair_forces);
+		vstore3((float3) (0.f, 0.f, 0.f), self_id, pair_forces);
+		STORE_PARTICLE_VEC(other_forces, self_id, fluid_other_forces, params->fluid_capacity);
+		fluid_pressures[self_id] = initial_pressure(fluid_pressures[self_id], warm_start);
+		STORE_PARTICLE_VEC((float3) (0.f, 0.f, 0.f), self_id, fluid_pressure_forces, params->fluid_capacity);
+		if(CONST_PARAM(params, kernel_fusion) == KERNEL_FUSION_PREDICT_WITH_FORCES)
+			STORE_PARTICLE_POS(params, predict_position(params, self_pos, self_vel, other_forces), self_id, fluid_predicted_positions, params->fluid_capacity);
+		return;
+	}
 				
 	// other forces
 	float3 viscosity_force = (float3) (0.f, 0.f, 0.f);
 	float3 st_cohesion = (float3) (0.f, 0.f, 0.f);
 	float3 st_curvature = (float3) (0.f, 0.f, 0.f);
 	
-	FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
-		const float3 other_pos = vload3(other_id, fluid_positions);
-		const float3 other_vel = vload3(other_id, fluid_velocities);
+	FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, fluid_neighbor_cache, fluid_cell_offsets, self_id, self_pos, {
+		const float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
+		const float3 other_vel = LOAD_PARTICLE_VEC(other_id, fluid_velocities, params->fluid_capacity);
 		const float other_density = fluid_densitites[other_id];
-		const float3 other_normal = vload3(other_id, fluid_normals);
+		const float3 other_normal = LOAD_PARTICLE_VEC(other_id, fluid_normals, params->fluid_capacity);
 		float dist = distance(self_pos, other_pos);
 
 		// -> viscosity
-		if(other_density > 0.0001f) {
-			viscosity_force += (other_vel - self_vel) * (kernel_viscosity_d2(dist, params->kernel_radius) / other_density);
+		if(FEATURE_VISCOSITY && other_density > 0.0001f) {
+			viscosity_force += (other_vel - self_vel) * (kernel_viscosity_d2(dist, CONST_PARAM(params, kernel_radius)) / other_density);
 		}
 		
-		if(dist > 0.0001f && dist < params->kernel_radius) {
-			float st_correction_factor = 2.f * params->rest_density / (self_density + other_density);
+		if(FEATURE_SURFACE_TENSION && dist > 0.0001f && dist < CONST_PARAM(params, kernel_radius)) {
+			float st_correction_factor = 2.f * PHYSICAL_PARAM(params, rest_density) / (self_density + other_density);
 			// -> surface tension (cohesion)
-			float st_kernel =  kernel_surface_tension(dist, params->kernel_radius, params->surface_tension_term);
+			float st_kernel =  kernel_surface_tension(dist, CONST_PARAM(params, kernel_radius), CONST_PARAM(params, surface_tension_term));
 			float3 direction = (self_pos - other_pos) / dist;
 			st_cohesion += st_correction_factor * st_kernel * direction;
 			
@@ -157,39 +228,61 @@ __kernel void force_initialization(__constant Simulation_Params* params, __globa
 			st_curvature += st_correction_factor * (self_normal - other_normal);
 		}
 	});
-	viscosity_force *= params->viscosity_constant * params->particle_mass * params->viscosity_d2_normalization;
+	viscosity_force *= PHYSICAL_PARAM(params, viscosity_constant) * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, viscosity_d2_normalization);
 	
-	st_cohesion *= -params->surface_tension_coefficient * params->particle_mass * params->particle_mass * params->surface_tension_normalization;
-	st_curvature *= -params->surface_tension_coefficient * params->particle_mass;
+	st_cohesion *= -PHYSICAL_PARAM(params, surface_tension_coefficient) * PHYSICAL_PARAM(params, particle_mass) * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, surface_tension_normalization);
+	st_curvature *= -PHYSICAL_PARAM(params, surface_tension_coefficient) * PHYSICAL_PARAM(params, particle_mass);
 	float3 surface_tension_force = (st_cohesion + st_curvature);
 
 	// -> store: viscosity + gravity
-	float3 other_forces = (float3) (0.f, params->particle_mass * params->gravity, 0.f) + viscosity_force + surface_tension_force;
-	vstore3(other_forces, self_id, fluid_other_forces);
+	float3 other_forces = gravity_force(params) + viscosity_force + surface_tension_force;
+	STORE_PARTICLE_VEC(other_forces, self_id, fluid_other_forces, params->fluid_capacity);
 
-	// pressure
-	fluid_pressures[self_id] = 0.f;
-	vstore3((float3) (0.f, 0.f, 0.f), self_id, fluid_pressure_forces);
+	// pressure (the force of warm-started pressures is evaluated by a separate pass, it overwrites the prediction below)
+	fluid_pressures[self_id] = initial_pressure(fluid_pressures[self_id], warm_start);
+	STORE_PARTICLE_VEC((float3) (0.f, 0.f, 0.f), self_id, fluid_pressure_forces, params->fluid_capacity);
+
+	// -> fused prediction of the first iteration (the pressure force is still 0)
+	if(CONST_PARAM(params, kernel_fusion) == KERNEL_FUSION_PREDICT_WITH_FORCES)
+		STORE_PARTICLE_POS(params, predict_position(params, self_pos, self_vel, other_forces), self_id, fluid_predicted_positions, params->fluid_capacity);
 }
 
 __kernel void update_position_and_velocity(__constant Simulation_Params* params, __global float* fluid_positions, __global float* fluid_velocities, 
                                            __global float* fluid_other_forces, __global float* fluid_pressure_forces,
-										   __global float* fluid_new_positions, __global float* fluid_new_velocities) {
+										   __global float* fluid_new_positions, __global float* fluid_new_velocities, __global uint* solver_state) {
 	if(get_global_id(0) >= params->fluid_count) return;
+	if(is_solver_converged(solver_state)) return;
 	
 	const uint self_id = get_global_id(0);
-	float3 self_pos = vload3(self_id, fluid_positions);
-	float3 self_vel = vload3(self_id, fluid_velocities);
-	float3 self_force = vload3(self_id, fluid_other_forces) + vload3(self_id, fluid_pressure_forces);
+	float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	float3 self_vel = LOAD_PARTICLE_VEC(self_id, fluid_velocities, params->fluid_capacity);
+	float3 self_force = LOAD_PARTICLE_VEC(self_id, fluid_other_forces, params->fluid_capacity) + LOAD_PARTICLE_VEC(self_id, fluid_pressure_forces, params->fluid_capacity);
 	
-	float3 acceleration = self_force / params->particle_mass;
+	float3 acceleration = self_force / PHYSICAL_PARAM(params, particle_mass);
 
 	self_vel += acceleration * params->delta_t;
 	self_pos += self_vel * params->delta_t;
 	
-	vstore3(self_pos, self_id, fluid_new_positions);
+	STORE_PARTICLE_POS(params, self_pos, self_id, fluid_new_positions, params->fluid_capacity);
 	if(fluid_new_velocities != 0x0)
-		vstore3(self_vel, self_id, fluid_new_velocities);
+		STORE_PARTICLE_VEC(self_vel, self_id, fluid_new_velocities, params->fluid_capacity);
+}
+
+// particle flow (Fluid::add_emitter): appends a batch of emitted particles (packed float3 positions) behind the active particles.
+// particles beyond the capacity are dropped. the new count is written to out_fluid_count and copied into the parameters by the host.
+// the emitted particles start at zero pressure (pressure warm start)
+__kernel void emit_particles(__constant Simulation_Params* params, uint batch_count, __global float* batch_positions, float4 velocity,
+                             __global float* fluid_positions, __global float* fluid_velocities, __global float* fluid_pressures, __global uint* out_fluid_count) {
+	const uint fluid_count = params->fluid_count;
+	if(get_global_id(0) == 0)
+		*out_fluid_count = min(fluid_count + batch_count, params->fluid_capacity);
+	if(get_global_id(0) >= batch_count) return;
+
+	const uint dst_id = fluid_count + get_global_id(0);
+	if(dst_id >= params->fluid_capacity) return;
+	STORE_PARTICLE_POS(params, vload3(get_global_id(0), batch_positions), dst_id, fluid_positions, params->fluid_capacity);
+	STORE_PARTICLE_VEC(velocity.xyz, dst_id, fluid_velocities, params->fluid_capacity);
+	fluid_pressures[dst_id] = 0.f;
 }
 
 __kernel void initialize_boundary_boundary_pred_densities(__constant Simulation_Params* params,
@@ -197,34 +290,38 @@ __kernel void initialize_boundary_boundary_pred_densities(__constant Simulation_
 	if(get_global_id(0) >= params->boundary_count) return;
 
 	const uint self_id = get_global_id(0);
-	const float3 self_pos = vload3(self_id, boundary_positions);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, boundary_positions, params->boundary_count);
 	
 	float result = 0.f;
 	FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
-		float3 other_pos = vload3(other_id, boundary_positions);
+		float3 other_pos = LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
 		float3 diff = self_pos - other_pos;
 		float r2 = dot(diff, diff);
-		result += kernel_poly6(r2, params->kernel_radius2);
+		result += kernel_poly6(r2, CONST_PARAM(params, kernel_radius2));
 	});
 	boundary_init_pred_densities[self_id] = result;
 } 
 
-__kernel void update_pressure(__constant Simulation_Params* params, int boundary_update,
-                              __global uint* boundary_cell_offsets, __global float* boundary_positions, __global float* boundary_init_pred_densities,
-                              __global uint* fluid_cell_offsets,  __global float* fluid_positions, __global float* fluid_predicted_positions, __global float* fluid_density_variations, __global float* output_pressures) {
+// boundary_update is a compile-time constant in both kernels below, the branches on it are folded away
+inline void update_pressure(__constant Simulation_Params* params, const bool boundary_update,
+                            __global uint* boundary_cell_offsets, __global uint* boundary_neighbor_cache, __global float* boundary_positions, __global float* boundary_init_pred_densities,
+                            __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache, __global float* fluid_positions, __global float* fluid_predicted_positions, __global float* fluid_density_variations, __global float* output_pressures,
+                            __global uint* solver_state, __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_pressure_forces) {
+	if(is_solver_converged(solver_state)) return;
+
 	const uint self_id = get_global_id(0);
 	float3 self_pos;
 	float3 self_pred_pos;
 
 	if(boundary_update) {
 		if(get_global_id(0) >= params->boundary_count) return;
-		self_pos = vload3(self_id, boundary_positions);
+		self_pos = LOAD_PARTICLE_POS(params, self_id, boundary_positions, params->boundary_count);
 		self_pred_pos = self_pos;
 	}
 	else {
 		if(get_global_id(0) >= params->fluid_count) return;
-		self_pos = vload3(self_id, fluid_positions);
-		self_pred_pos = vload3(self_id, fluid_predicted_positions);
+		self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+		self_pred_pos = load_predicted_position(params, self_id, fluid_positions, fluid_predicted_positions, fluid_velocities, fluid_other_forces, fluid_pressure_forces);
 	}
 
 	
@@ -235,24 +332,24 @@ __kernel void update_pressure(__constant Simulation_Params* params, int boundary
 		pred_density += boundary_init_pred_densities[self_id];
 	}
 	else {
-		FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
-			float3 other_pred_pos = vload3(other_id, boundary_positions);
+		if(FEATURE_BOUNDARY) FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, boundary_neighbor_cache, boundary_cell_offsets, self_id, self_pos, {
+			float3 other_pred_pos = LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
 			float3 diff = self_pred_pos - other_pred_pos;
 			float r2 = dot(diff, diff);
-			pred_density += kernel_poly6(r2, params->kernel_radius2);
+			pred_density += kernel_poly6(r2, CONST_PARAM(params, kernel_radius2));
 		});
 	}
-	// -> fluid particles
-	FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
-		float3 other_pred_pos = vload3(other_id, fluid_predicted_positions);
+	// -> fluid particles (the neighbor caches are only bound for fluid particles)
+	FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, fluid_neighbor_cache, fluid_cell_offsets, self_id, self_pos, {
+		float3 other_pred_pos = load_predicted_position(params, other_id, fluid_positions, fluid_predicted_positions, fluid_velocities, fluid_other_forces, fluid_pressure_forces);
 		float3 diff = self_pred_pos - other_pred_pos;
 		float r2 = dot(diff, diff);
-		pred_density += kernel_poly6(r2, params->kernel_radius2);
+		pred_density += kernel_poly6(r2, CONST_PARAM(params, kernel_radius2));
 	});
-	pred_density *= params->particle_mass * params->poly6_normalization;
+	pred_density *= PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, poly6_normalization);
 	
 	// calculate density variation
-	float density_variation = max(0.f, pred_density - params->rest_density);
+	float density_variation = max(0.f, pred_density - PHYSICAL_PARAM(params, rest_density));
 	if(fluid_density_variations != 0x0)
 		fluid_density_variations[self_id] = density_variation;
 	if(density_variation == 0.f)
@@ -262,41 +359,327 @@ __kernel void update_pressure(__constant Simulation_Params* params, int boundary
 	output_pressures[self_id] += density_variation * params->density_variation_scaling_factor;
 }
 
+__kernel void update_boundary_pressure(__constant Simulation_Params* params,
+                                       __global uint* boundary_cell_offsets, __global uint* boundary_neighbor_cache, __global float* boundary_positions, __global float* boundary_init_pred_densities,
+                                       __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache, __global float* fluid_positions, __global float* fluid_predicted_positions, __global float* fluid_density_variations, __global float* output_pressures,
+                                       __global uint* solver_state, __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_pressure_forces) {
+	update_pressure(params, true, boundary_cell_offsets, boundary_neighbor_cache, boundary_positions, boundary_init_pred_densities,
+	                fluid_cell_offsets, fluid_neighbor_cache, fluid_positions, fluid_predicted_positions, fluid_density_variations, output_pressures,
+	                solver_state, fluid_velocities, fluid_other_forces, fluid_pressure_forces);
+}
+
+__kernel void update_fluid_pressure(__constant Simulation_Params* params,
+                                    __global uint* boundary_cell_offsets, __global uint* boundary_neighbor_cache, __global float* boundary_positions, __global float* boundary_init_pred_densities,
+                                    __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache, __global float* fluid_positions, __global float* fluid_predicted_positions, __global float* fluid_density_variations, __global float* output_pressures,
+                                    __global uint* solver_state, __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_pressure_forces) {
+	update_pressure(params, false, boundary_cell_offsets, boundary_neighbor_cache, boundary_positions, boundary_init_pred_densities,
+	                fluid_cell_offsets, fluid_neighbor_cache, fluid_positions, fluid_predicted_positions, fluid_density_variations, output_pressures,
+	                solver_state, fluid_velocities, fluid_other_forces, fluid_pressure_forces);
+}
+
 __kernel void update_pressure_force(__constant Simulation_Params* params, 
-                                    __global uint* boundary_cell_offsets, __global float* boundary_positions, __global float* boundary_pressures,
-							        __global uint* fluid_cell_offsets, __global float* fluid_positions, 
-                                    __global float* fluid_densities, __global float* fluid_pressures, __global float* fluid_pressure_forces) {
+                                    __global uint* boundary_cell_offsets, __global uint* boundary_neighbor_cache, __global float* boundary_positions, __global float* boundary_pressures,
+							        __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache, __global float* fluid_positions, 
+                                    __global float* fluid_densities, __global float* fluid_pressures, __global float* fluid_pressure_forces,
+                                    __global uint* solver_state, __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_predicted_positions,
+                                    __global float* pair_forces) {
 	if(get_global_id(0) >= params->fluid_count) return;
+	if(is_solver_converged(solver_state)) return;
 
 	const uint self_id = get_global_id(0);
-	const float3 self_pos = vload3(self_id, fluid_positions);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
 	const float self_pressure = fluid_pressures[self_id];
 	const float self_density = fluid_densities[self_id];
 	const float self_factor = self_pressure / (self_density * self_density);
 
 	float3 pressure_force = (float3) (0.f, 0.f, 0.f);
 	// -> boundary particles
-	FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
-		float3 other_pos = vload3(other_id, boundary_positions);
+	if(FEATURE_BOUNDARY) FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, boundary_neighbor_cache, boundary_cell_offsets, self_id, self_pos, {
+		float3 other_pos = LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
 		float other_pressure = boundary_pressures[other_id];
-		float other_density = params->rest_density;
+		float other_density = PHYSICAL_PARAM(params, rest_density);
 		float other_factor = other_pressure / (other_density * other_density);
 		float factor = self_factor + other_factor;
-		pressure_force += kernel_spiky_d1(self_pos - other_pos, params->kernel_radius) * factor;
+		pressure_force += kernel_spiky_d1(self_pos - other_pos, CONST_PARAM(params, kernel_radius)) * factor;
 	});
 	// -> fluid particles
-	FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
-		float3 other_pos = vload3(other_id, fluid_positions);
-		float other_pressure = fluid_pressures[other_id];
-		float other_density = fluid_densities[other_id];
-		float other_factor = other_pressure / (other_density * other_density);
-		float factor = self_factor + other_factor;
-		pressure_force += kernel_spiky_d1(self_pos - other_pos, params->kernel_radius) * factor;
+	if(pair_forces == 0x0) {
+		FOREACH_NEIGHBOR_OF_FLUID_PARTICLE(params, fluid_neighbor_cache, fluid_cell_offsets, self_id, self_pos, {
+			float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
+			float other_pressure = fluid_pressures[other_id];
+			float other_density = fluid_densities[other_id];
+			float other_factor = other_pressure / (other_density * other_density);
+			float factor = self_factor + other_factor;
+			pressure_force += kernel_spiky_d1(self_pos - other_pos, CONST_PARAM(params, kernel_radius)) * factor;
+		});
+	}
+
+	pressure_force *= -CONST_PARAM(params, spiky_d1_normalization) * PHYSICAL_PARAM(params, particle_mass) * PHYSICAL_PARAM(params, particle_mass);
+
+	// -> symmetric pair evaluation: accumulated by accumulate_pressure_forces (cleared for the next iteration)
+	if(pair_forces != 0x0) {
+		pressure_force += vload3(self_id, pair_forces);
+		vstore3((float3) (0.f, 0.f, 0.f), self_id, pair_forces);
+	}
+
+	STORE_PARTICLE_VEC(pressure_force, self_id, fluid_pressure_forces, params->fluid_capacity);
+
+	// -> fused prediction of the next iteration
+	if(CONST_PARAM(params, kernel_fusion) == KERNEL_FUSION_PREDICT_WITH_FORCES) {
+		const float3 self_vel = LOAD_PARTICLE_VEC(self_id, fluid_velocities, params->fluid_capacity);
+		const float3 self_force = LOAD_PARTICLE_VEC(self_id, fluid_other_forces, params->fluid_capacity) + pressure_force;
+		STORE_PARTICLE_POS(params, predict_position(params, self_pos, self_vel, self_force), self_id, fluid_predicted_positions, params->fluid_capacity);
+	}
+}
+
+// fluid-fluid part of force_initialization (viscosity, surface tension) and update_pressure_force per pair of particles.
+// symmetric: every pair is evaluated once and both particles get their (opposite) share, so the fluid-fluid forces
+// conserve momentum exactly. the viscosity uses the mean density of the pair instead of the neighbor density in this mode
+__kernel void accumulate_other_forces(__constant Simulation_Params* params, uint symmetric, __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache,
+                                      __global float* fluid_positions, __global float* fluid_normals, __global float* fluid_densitites, __global float* fluid_velocities,
+                                      __global float* pair_forces) {
+	if(get_global_id(0) >= params->fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	const float3 self_vel = LOAD_PARTICLE_VEC(self_id, fluid_velocities, params->fluid_capacity);
+	const float self_density = fluid_densitites[self_id];
+	const float3 self_normal = LOAD_PARTICLE_VEC(self_id, fluid_normals, params->fluid_capacity);
+
+	const float viscosity_scale = PHYSICAL_PARAM(params, viscosity_constant) * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, viscosity_d2_normalization);
+	const float cohesion_scale = -PHYSICAL_PARAM(params, surface_tension_coefficient) * PHYSICAL_PARAM(params, particle_mass) * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, surface_tension_normalization);
+	const float curvature_scale = -PHYSICAL_PARAM(params, surface_tension_coefficient) * PHYSICAL_PARAM(params, particle_mass);
+
+	float3 self_force = (float3) (0.f, 0.f, 0.f);
+	FOREACH_FLUID_PAIR(params, fluid_neighbor_cache, fluid_cell_offsets, symmetric, self_id, self_pos, {
+		const float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
+		const float3 other_vel = LOAD_PARTICLE_VEC(other_id, fluid_velocities, params->fluid_capacity);
+		const float other_density = fluid_densitites[other_id];
+		const float3 other_normal = LOAD_PARTICLE_VEC(other_id, fluid_normals, params->fluid_capacity);
+		const float dist = distance(self_pos, other_pos);
+		float3 force = (float3) (0.f, 0.f, 0.f);
+
+		// -> viscosity
+		const float viscosity_density = symmetric ? 0.5f * (self_density + other_density) : other_density;
+		if(FEATURE_VISCOSITY && viscosity_density > 0.0001f)
+			force += (other_vel - self_vel) * (kernel_viscosity_d2(dist, CONST_PARAM(params, kernel_radius)) / viscosity_density) * viscosity_scale;
+
+		// -> surface tension (cohesion / curvature)
+		if(FEATURE_SURFACE_TENSION && dist > 0.0001f && dist < CONST_PARAM(params, kernel_radius)) {
+			const float st_correction_factor = 2.f * PHYSICAL_PARAM(params, rest_density) / (self_density + other_density);
+			const float st_kernel = kernel_surface_tension(dist, CONST_PARAM(params, kernel_radius), CONST_PARAM(params, surface_tension_term));
+			force += st_correction_factor * st_kernel * (self_pos - other_pos) / dist * cohesion_scale;
+			force += st_correction_factor * (self_normal - other_normal) * curvature_scale;
+		}
+
+		self_force += force;
+		if(symmetric)
+			atomic_add_pair_force(pair_forces, other_id, -force);
+	});
+	store_pair_force(pair_forces, symmetric, self_id, self_force);
+}
+
+__kernel void accumulate_pressure_forces(__constant Simulation_Params* params, uint symmetric, __global uint* fluid_cell_offsets, __global uint* fluid_neighbor_cache,
+                                         __global float* fluid_positions, __global float* fluid_densities, __global float* fluid_pressures, 
+                                         __global float* pair_forces, __global uint* solver_state) {
+	if(get_global_id(0) >= params->fluid_count) return;
+	if(is_solver_converged(solver_state)) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	const float self_density = fluid_densities[self_id];
+	const float self_factor = fluid_pressures[self_id] / (self_density * self_density);
+	const float pressure_scale = -CONST_PARAM(params, spiky_d1_normalization) * PHYSICAL_PARAM(params, particle_mass) * PHYSICAL_PARAM(params, particle_mass);
+
+	float3 self_force = (float3) (0.f, 0.f, 0.f);
+	FOREACH_FLUID_PAIR(params, fluid_neighbor_cache, fluid_cell_offsets, symmetric, self_id, self_pos, {
+		const float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
+		const float other_density = fluid_densities[other_id];
+		const float other_factor = fluid_pressures[other_id] / (other_density * other_density);
+		const float3 force = kernel_spiky_d1(self_pos - other_pos, CONST_PARAM(params, kernel_radius)) * ((self_factor + other_factor) * pressure_scale);
+
+		self_force += force;
+		if(symmetric)
+			atomic_add_pair_force(pair_forces, other_id, -force);
+	});
+	store_pair_force(pair_forces, symmetric, self_id, self_force);
+}
+
+// work-group per cell variants of update_density, update_pressure (fluid) and update_pressure_force (see sim::Work_Distribution).
+// the neighborhood of a cell is loaded once per work-group into local memory (tile: one float4 per neighbor), 
+// the neighbor caches aren't used. particles of another cell in the same bucket (hash collisions) search the grid themselves
+__kernel void update_density_tiled(__constant Simulation_Params* params, 
+                                   __global uint* boundary_cell_offsets, __global float* boundary_positions,
+                                   __global uint* fluid_cell_offsets, __global float* fluid_positions, __global float* fluid_densitites,
+                                   __global uint* occupied_cells, __local float4* tile, __local uint* tile_cells) {
+	FOREACH_OCCUPIED_CELL_CHUNK(params, occupied_cells, fluid_positions, {
+		const float3 self_pos = is_active ? LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity) : (float3)(0.f, 0.f, 0.f);
+		const bool is_tiled = is_active && all(get_grid_cell_pos(params, self_pos) == cell_pos);
+		float density = 0.f;
+
+		// boundary neighbors
+		if(FEATURE_BOUNDARY) FOREACH_TILED_NEIGHBOR(params, boundary_cell_offsets, cell_pos, tile_cells, is_tiled, {
+			tile[tile_slot] = (float4)(LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count), 0.f);
+		}, {
+			const float3 diff = self_pos - tile[tile_slot].xyz;
+			density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+		});
+
+		// fluid neighbors
+		FOREACH_TILED_NEIGHBOR(params, fluid_cell_offsets, cell_pos, tile_cells, is_tiled, {
+			tile[tile_slot] = (float4)(LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity), 0.f);
+		}, {
+			const float3 diff = self_pos - tile[tile_slot].xyz;
+			density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+		});
+
+		if(is_active && !is_tiled) {
+			if(FEATURE_BOUNDARY) FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
+				const float3 diff = self_pos - LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
+				density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+			});
+			FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
+				const float3 diff = self_pos - LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
+				density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+			});
+		}
+
+		if(is_active)
+			fluid_densitites[self_id] = density * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, poly6_normalization);
+	});
+}
+
+__kernel void update_pressure_tiled(__constant Simulation_Params* params, 
+                                    __global uint* boundary_cell_offsets, __global float* boundary_positions,
+                                    __global uint* fluid_cell_offsets, __global float* fluid_positions, __global float* fluid_predicted_positions, 
+                                    __global float* fluid_density_variations, __global float* output_pressures, __global uint* solver_state, 
+                                    __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_pressure_forces,
+                                    __global uint* occupied_cells, __local float4* tile, __local uint* tile_cells) {
+	if(is_solver_converged(solver_state)) return;
+
+	FOREACH_OCCUPIED_CELL_CHUNK(params, occupied_cells, fluid_positions, {
+		const float3 self_pos = is_active ? LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity) : (float3)(0.f, 0.f, 0.f);
+		const float3 self_pred_pos = is_active ? 
+			load_predicted_position(params, self_id, fluid_positions, fluid_predicted_positions, fluid_velocities, fluid_other_forces, fluid_pressure_forces) : self_pos;
+		const bool is_tiled = is_active && all(get_grid_cell_pos(params, self_pos) == cell_pos);
+		float pred_density = 0.f;
+
+		// -> boundary particles
+		if(FEATURE_BOUNDARY) FOREACH_TILED_NEIGHBOR(params, boundary_cell_offsets, cell_pos, tile_cells, is_tiled, {
+			tile[tile_slot] = (float4)(LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count), 0.f);
+		}, {
+			const float3 diff = self_pred_pos - tile[tile_slot].xyz;
+			pred_density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+		});
+
+		// -> fluid particles
+		FOREACH_TILED_NEIGHBOR(params, fluid_cell_offsets, cell_pos, tile_cells, is_tiled, {
+			tile[tile_slot] = (float4)(load_predicted_position(params, other_id, fluid_positions, fluid_predicted_positions, 
+				fluid_velocities, fluid_other_forces, fluid_pressure_forces), 0.f);
+		}, {
+			const float3 diff = self_pred_pos - tile[tile_slot].xyz;
+			pred_density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+		});
+
+		if(is_active && !is_tiled) {
+			if(FEATURE_BOUNDARY) FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
+				const float3 diff = self_pred_pos - LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
+				pred_density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+			});
+			FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
+				const float3 diff = self_pred_pos - load_predicted_position(params, other_id, fluid_positions, fluid_predicted_positions, 
+					fluid_velocities, fluid_other_forces, fluid_pressure_forces);
+				pred_density += kernel_poly6(dot(diff, diff), CONST_PARAM(params, kernel_radius2));
+			});
+		}
+
+		// density variation / pressure
+		if(is_active) {
+			const float density_variation = max(0.f, pred_density * PHYSICAL_PARAM(params, particle_mass) * CONST_PARAM(params, poly6_normalization) - PHYSICAL_PARAM(params, rest_density));
+			if(fluid_density_variations != 0x0)
+				fluid_density_variations[self_id] = density_variation;
+			output_pressures[self_id] += density_variation * params->density_variation_scaling_factor;
+		}
+	});
+}
+
+__kernel void update_pressure_force_tiled(__constant Simulation_Params* params, 
+                                          __global uint* boundary_cell_offsets, __global float* boundary_positions, __global float* boundary_pressures,
+                                          __global uint* fluid_cell_offsets, __global float* fluid_positions, 
+                                          __global float* fluid_densities, __global float* fluid_pressures, __global float* fluid_pressure_forces,
+                                          __global uint* solver_state, __global float* fluid_velocities, __global float* fluid_other_forces, __global float* fluid_predicted_positions,
+                                          __global uint* occupied_cells, __local float4* tile, __local uint* tile_cells) {
+	if(is_solver_converged(solver_state)) return;
+
+	const float boundary_density2 = PHYSICAL_PARAM(params, rest_density) * PHYSICAL_PARAM(params, rest_density);
+
+	FOREACH_OCCUPIED_CELL_CHUNK(params, occupied_cells, fluid_positions, {
+		const float3 self_pos = is_active ? LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity) : (float3)(0.f, 0.f, 0.f);
+		const float self_density = is_active ? fluid_densities[self_id] : 1.f;
+		const float self_factor = is_active ? fluid_pressures[self_id] / (self_density * self_density) : 0.f;
+		const bool is_tiled = is_active && all(get_grid_cell_pos(params, self_pos) == cell_pos);
+		float3 pressure_force = (float3) (0.f, 0.f, 0.f);
+
+		// tile: position and pressure / density^2 of the neighbor
+		// -> boundary particles
+		if(FEATURE_BOUNDARY) FOREACH_TILED_NEIGHBOR(params, boundary_cell_offsets, cell_pos, tile_cells, is_tiled, {
+			tile[tile_slot] = (float4)(LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count), boundary_pressures[other_id] / boundary_density2);
+		}, {
+			const float4 other = tile[tile_slot];
+			pressure_force += kernel_spiky_d1(self_pos - other.xyz, CONST_PARAM(params, kernel_radius)) * (self_factor + other.w);
+		});
+
+		// -> fluid particles
+		FOREACH_TILED_NEIGHBOR(params, fluid_cell_offsets, cell_pos, tile_cells, is_tiled, {
+			const float other_density = fluid_densities[other_id];
+			tile[tile_slot] = (float4)(LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity), fluid_pressures[other_id] / (other_density * other_density));
+		}, {
+			const float4 other = tile[tile_slot];
+			pressure_force += kernel_spiky_d1(self_pos - other.xyz, CONST_PARAM(params, kernel_radius)) * (self_factor + other.w);
+		});
+
+		if(is_active && !is_tiled) {
+			if(FEATURE_BOUNDARY) FOREACH_NEIGHBOR(params, boundary_cell_offsets, self_pos, {
+				const float3 other_pos = LOAD_PARTICLE_POS(params, other_id, boundary_positions, params->boundary_count);
+				pressure_force += kernel_spiky_d1(self_pos - other_pos, CONST_PARAM(params, kernel_radius)) * (self_factor + boundary_pressures[other_id] / boundary_density2);
+			});
+			FOREACH_NEIGHBOR(params, fluid_cell_offsets, self_pos, {
+				const float3 other_pos = LOAD_PARTICLE_POS(params, other_id, fluid_positions, params->fluid_capacity);
+				const float other_density = fluid_densities[other_id];
+				pressure_force += kernel_spiky_d1(self_pos - other_pos, CONST_PARAM(params, kernel_radius)) * (self_factor + fluid_pressures[other_id] / (other_density * other_density));
+			});
+		}
+
+		if(is_active) {
+			pressure_force *= -CONST_PARAM(params, spiky_d1_normalization) * PHYSICAL_PARAM(params, particle_mass) * PHYSICAL_PARAM(params, particle_mass);
+			STORE_PARTICLE_VEC(pressure_force, self_id, fluid_pressure_forces, params->fluid_capacity);
+
+			// -> fused prediction of the next iteration
+			if(CONST_PARAM(params, kernel_fusion) == KERNEL_FUSION_PREDICT_WITH_FORCES) {
+				const float3 self_vel = LOAD_PARTICLE_VEC(self_id, fluid_velocities, params->fluid_capacity);
+				const float3 self_force = LOAD_PARTICLE_VEC(self_id, fluid_other_forces, params->fluid_capacity) + pressure_force;
+				STORE_PARTICLE_POS(params, predict_position(params, self_pos, self_vel, self_force), self_id, fluid_predicted_positions, params->fluid_capacity);
+			}
+		}
 	});
+}
+
+__kernel void reset_solver_state(__global uint* solver_state) {
+	solver_state[0] = 0;
+	solver_state[1] = 0;
+}
+
+__kernel void update_solver_state(__constant Simulation_Params* params, float density_variation_threshold, uint min_iterations, 
+                                  __global float* density_variation_result, __global uint* solver_state, uint step, __global uint* step_iterations) {
+	if(is_solver_converged(solver_state)) return;
 
-	pressure_force *= -params->spiky_d1_normalization * params->particle_mass * params->particle_mass;
+	const uint iterations = solver_state[1] + 1;
+	solver_state[1] = iterations;
+	step_iterations[step] = iterations;
 
-	vstore3(pressure_force, self_id, fluid_pressure_forces);
+	// the density variation result is only computed after min_iterations
+	if(iterations > min_iterations && density_variation_result[0] / PHYSICAL_PARAM(params, rest_density) < density_variation_threshold)
+		solver_state[0] = 1;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef REDUCE_UTILS_H
+#define REDUCE_UTILS_H
+
+// reduces two values (max, sum) in local memory. the local size has to be a power of two
+void reduce_local_max_and_sum(__local float* local_max, __local float* local_sum, float max_value, float sum) {
+	const uint local_id = get_local_id(0);
+	local_max[local_id] = max_value;
+	local_sum[local_id] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(uint offset = get_local_size(0) / 2; offset > 0; offset /= 2) {
+		if(local_id < offset) {
+			local_max[local_id] = max(local_max[local_id], local_max[local_id + offset]);
+			local_sum[local_id] += local_sum[local_id + offset];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+// first pass: every work-group reduces a strided part of the values into one (max, sum) pair.
+// the value count is read from the device (e.g. the active fluid count)
+__kernel void reduce_max_and_sum(__global uint* value_count, __global float* values, __global float* out_partial_results,
+                                 __local float* local_max, __local float* local_sum) {
+	const uint count = *value_count;
+	float max_value = -INFINITY;
+	float sum = 0.f;
+	for(uint i = get_global_id(0); i < count; i += get_global_size(0)) {
+		const float value = values[i];
+		max_value = max(max_value, value);
+		sum += value;
+	}
+
+	reduce_local_max_and_sum(local_max, local_sum, max_value, sum);
+	if(get_local_id(0) == 0)
+		vstore2((float2)(local_max[0], local_sum[0]), get_group_id(0), out_partial_results);
+}
+
+// second pass: a single work-group reduces the (max, sum) pairs of the first pass
+__kernel void reduce_max_and_sum_partials(uint partial_count, __global float* partial_results, __global float* out_result,
+                                          __local float* local_max, __local float* local_sum) {
+	float max_value = -INFINITY;
+	float sum = 0.f;
+	for(uint i = get_local_id(0); i < partial_count; i += get_local_size(0)) {
+		const float2 partial = vload2(i, partial_results);
+		max_value = max(max_value, partial.x);
+		sum += partial.y;
+	}
+
+	reduce_local_max_and_sum(local_max, local_sum, max_value, sum);
+	if(get_local_id(0) == 0)
+		vstore2((float2)(local_max[0], local_sum[0]), 0, out_result);
+}
+
+#endif
\ No newline at end of file
@@ -5,7 +5,7 @@
 #include <data/kernels/grid_utils.cl>
 
 __kernel void reset_cell_offsets(__constant Simulation_Params* params, __global uint* cell_offsets) {
-	if(get_global_id(0) >= params->bucket_count) return;
+	if(get_global_id(0) >= CONST_PARAM(params, bucket_count)) return;
 	vstore2((uint2)(0,0), get_global_id(0), cell_offsets);
 }
 
@@ -13,15 +13,68 @@ __kernel void initialize(__constant Simulation_Params* params, uint particle_cou
 	if(get_global_id(0) >= particle_count) return;
 
 	const uint self_id = get_global_id(0);
-	const float3 self_pos = vload3(self_id, particle_positions);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, particle_positions, particle_count);
 	
-	const int3 cell_pos = get_cell_pos(self_pos, params->cell_size);
-	const uint hash_key = get_hash_key(cell_pos, params->bucket_count);
+	const int3 cell_pos = get_grid_cell_pos(params, self_pos);
+	const uint hash_key = get_cell_key(params, cell_pos);
 	
 	particle_keys[self_id] = hash_key;
 	particle_src_locations[self_id] = self_id;
 }
 
+// particle flow: removed fluid particles get the key bucket_count and are sorted behind the active ones (stream compaction).
+// the slots behind the active count, particles inside of a sink box (6 floats per box: lower, upper) and, if cull_outside_domain
+// is set, particles outside of the position domain (range of the compressed positions) are removed
+inline uint get_fluid_sort_key(__constant Simulation_Params* params, uint id, float3 pos, __global float* sink_boxes, uint sink_count, uint cull_outside_domain) {
+	bool removed = id >= params->fluid_count;
+	for(uint i = 0; i < sink_count && !removed; i++) {
+		const float3 lower = vload3(2 * i, sink_boxes);
+		const float3 upper = vload3(2 * i + 1, sink_boxes);
+		removed = all(pos >= lower) && all(pos <= upper);
+	}
+	if(cull_outside_domain && !removed) {
+		const float3 origin = (float3)(params->position_origin_x, params->position_origin_y, params->position_origin_z);
+		removed = any(pos < origin) || any(pos > origin + 65535.f / params->position_scale);
+	}
+	return removed ? CONST_PARAM(params, bucket_count) : get_cell_key(params, get_grid_cell_pos(params, pos));
+}
+
+__kernel void initialize_fluid(__constant Simulation_Params* params, uint particle_count, __global uint* particle_keys, __global float* particle_positions, __global uint* particle_src_locations,
+	__global float* sink_boxes, uint sink_count, uint cull_outside_domain) {
+	if(get_global_id(0) >= particle_count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, particle_positions, params->fluid_capacity);
+	particle_keys[self_id] = get_fluid_sort_key(params, self_id, self_pos, sink_boxes, sink_count, cull_outside_domain);
+	particle_src_locations[self_id] = self_id;
+}
+
+// active count after sorting with removed particles (the first particle with the key bucket_count)
+__kernel void update_sorted_fluid_count(__constant Simulation_Params* params, uint particle_count, __global uint* sorted_keys, __global uint* out_fluid_count) {
+	const uint self_id = get_global_id(0);
+	if(self_id >= particle_count) return;
+
+	const bool active = sorted_keys[self_id] < CONST_PARAM(params, bucket_count);
+	const bool next_active = self_id + 1 < particle_count && sorted_keys[self_id + 1] < CONST_PARAM(params, bucket_count);
+	if(self_id == 0 && !active)
+		*out_fluid_count = 0;
+	if(active && !next_active)
+		*out_fluid_count = self_id + 1;
+}
+
+// writes the cell start / end if the sorted particle at dst_loc is the first / last one of its cell
+inline void insert_cell_offset(uint particle_count, __global uint* cell_offsets, __global uint* sorted_keys, uint dst_loc) {
+	uint cur_key = sorted_keys[dst_loc];
+	// -> cur_key != prev_key => cell start
+	if(dst_loc == 0 || cur_key != sorted_keys[dst_loc - 1]) {
+		cell_offsets[2 * cur_key + 0] = dst_loc;
+	}
+	// -> cur_key != next_key => cell end
+	if(dst_loc == particle_count - 1 || cur_key != sorted_keys[dst_loc + 1]) {
+		cell_offsets[2 * cur_key + 1] = dst_loc + 1;
+	}
+}
+
 __kernel void reorder_and_insert_boundary_offsets(uint boundary_count, 
 	__global uint* cell_offsets, __global uint* src_locations, __global uint* boundary_keys,
 	__global float* in_positions, __global float* out_positions) {
@@ -34,46 +87,244 @@ __kernel void reorder_and_insert_boundary_offsets(uint boundary_count,
 
 	// reorder all attributes
 	// -> positions
-	vstore3(vload3(src_loc, in_positions), dst_loc, out_positions);
+	COPY_PARTICLE_VEC(src_loc, in_positions, dst_loc, out_positions, boundary_count);
 
 	// calculate offset
-	uint cur_key = boundary_keys[dst_loc];
-	// -> cur_key != prev_key => cell start
-	if(dst_loc == 0 || cur_key != boundary_keys[dst_loc - 1]) {
-		cell_offsets[2 * cur_key + 0] = dst_loc;
+	insert_cell_offset(boundary_count, cell_offsets, boundary_keys, dst_loc);
+}
+
+// counting sort: cell_starts has bucket_count + 1 entries, the exclusive scan (clogs) turns the counts into the cell starts.
+// the particles are scattered by the generated scatter_fluid_attributes kernel (Fluid::generate_attribute_kernels).
+// removed particles are counted in the last entry, so its start becomes the active count
+__kernel void reset_cell_counts(__constant Simulation_Params* params, __global uint* cell_counts) {
+	if(get_global_id(0) > CONST_PARAM(params, bucket_count)) return;
+	cell_counts[get_global_id(0)] = 0;
+}
+
+__kernel void count_particles_per_cell(__constant Simulation_Params* params, uint particle_count, __global float* particle_positions,
+	__global uint* cell_counts, __global uint* particle_keys, __global uint* particle_cell_indices,
+	__global float* sink_boxes, uint sink_count, uint cull_outside_domain) {
+	if(get_global_id(0) >= particle_count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, particle_positions, params->fluid_capacity);
+	const uint key = get_fluid_sort_key(params, self_id, self_pos, sink_boxes, sink_count, cull_outside_domain);
+
+	particle_keys[self_id] = key;
+	// -> position inside of the cell
+	particle_cell_indices[self_id] = atomic_inc(&cell_counts[key]);
+}
+
+__kernel void insert_counted_cell_offsets(__constant Simulation_Params* params, __global uint* cell_starts, __global uint* cell_offsets) {
+	if(get_global_id(0) >= CONST_PARAM(params, bucket_count)) return;
+
+	const uint key = get_global_id(0);
+	vstore2((uint2)(cell_starts[key], cell_starts[key + 1]), key, cell_offsets);
+}
+
+// incremental sort: the particles are still sorted by the keys of the previous step.
+// only the particles which changed their cell (movers) are sorted, the others keep their relative order and both 
+// sequences are merged afterwards. moved_flags and mover_offsets have fluid_count + 1 entries, the exclusive scan 
+// of the flags (clogs) gives the mover offsets and the mover count in the last entry.
+// the path is chosen on the device (no host synchronization): the movers are sorted over a fixed mover_capacity, if more
+// particles moved the keys are sorted by counting instead (full fallback, see select_sort_path)
+__kernel void flag_moved_particles(__constant Simulation_Params* params, uint fluid_count, __global float* fluid_positions, 
+	__global uint* fluid_keys, __global uint* moved_flags) {
+	if(get_global_id(0) == 0)
+		moved_flags[fluid_count] = 0;
+	if(get_global_id(0) >= fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	const uint key = get_cell_key(params, get_grid_cell_pos(params, self_pos));
+
+	moved_flags[self_id] = key != fluid_keys[self_id] ? 1 : 0;
+	fluid_keys[self_id] = key;
+}
+
+// sort_state: (incremental path, full fallbacks, incremental sorts, moved particles of the incremental sorts).
+// the counters accumulate over all steps (read by the host with its regular synchronization)
+__kernel void select_sort_path(uint fluid_count, uint mover_capacity, __global uint* mover_offsets, __global uint* sort_state) {
+	const uint mover_count = mover_offsets[fluid_count];
+	const bool incremental = mover_count <= mover_capacity;
+	sort_state[0] = incremental ? 1 : 0;
+	if(incremental) {
+		sort_state[2]++;
+		sort_state[3] += mover_count;
 	}
-	// -> cur_key != next_key => cell end
-	if(dst_loc == boundary_count - 1 || cur_key != boundary_keys[dst_loc + 1]) {
-		cell_offsets[2 * cur_key + 1] = dst_loc + 1;
+	else
+		sort_state[1]++;
+}
+
+// cell counts of the full fallback (cell_counts has bucket_count + 1 entries)
+__kernel void reset_fallback_cell_counts(__constant Simulation_Params* params, __global uint* sort_state, __global uint* cell_counts) {
+	if(get_global_id(0) > CONST_PARAM(params, bucket_count) || sort_state[0]) return;
+	cell_counts[get_global_id(0)] = 0;
+}
+
+// incremental path: movers and remaining particles are separated, the mover keys behind the movers are padded with bucket_count
+// (the movers are sorted over mover_capacity). full fallback: the keys are copied to stay_keys and counted per cell,
+// moved_flags holds the position inside of the cell (the mover buffers are permuted by the mover sort)
+__kernel void gather_moved_particles(__constant Simulation_Params* params, uint fluid_count, uint mover_capacity, __global uint* fluid_keys, 
+	__global uint* moved_flags, __global uint* mover_offsets, __global uint* stay_keys, __global uint* mover_keys, __global uint* mover_ids,
+	__global uint* sort_state, __global uint* cell_counts) {
+	if(get_global_id(0) >= fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	const uint key = fluid_keys[self_id];
+	if(!sort_state[0]) {
+		stay_keys[self_id] = key;
+		moved_flags[self_id] = atomic_inc(&cell_counts[key]);
+		return;
+	}
+
+	const uint mover_offset = mover_offsets[self_id];
+	if(moved_flags[self_id]) {
+		mover_keys[mover_offset] = key;
+		mover_ids[mover_offset] = self_id;
 	}
+	else {
+		stay_keys[self_id - mover_offset] = key;
+	}
+
+	// -> padding (sorted behind the movers)
+	const uint padding_id = mover_offsets[fluid_count] + self_id;
+	if(padding_id < mover_capacity)
+		mover_keys[padding_id] = CONST_PARAM(params, bucket_count);
 }
 
-__kernel void reorder_and_insert_fluid_offsets(uint fluid_count, 
-	__global uint* cell_offsets, __global uint* src_locations, __global uint* fluid_keys,
-	__global float* in_positions, __global float* in_velocities,
-	__global float* out_positions, __global float* out_velocities) {
-	uint dst_loc = get_global_id(0);
-	if(dst_loc >= fluid_count)
+// number of keys < key (lower = true) or <= key (lower = false) in a sorted sequence
+inline uint count_sorted_keys(__global uint* keys, uint count, uint key, bool lower) {
+	uint low = 0;
+	uint high = count;
+	while(low < high) {
+		uint mid = (low + high) / 2;
+		if(keys[mid] < key || (!lower && keys[mid] == key))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+// merges the remaining particles and the sorted movers (the remaining particles come first in a cell).
+// every work item places its own particle if it didn't move and the sorted mover with the same index.
+// full fallback: every particle is placed at its cell start (exclusive scan of the counts) + its position inside of the cell
+__kernel void merge_moved_particles(uint fluid_count, __global uint* moved_flags, __global uint* mover_offsets, 
+	__global uint* stay_keys, __global uint* mover_keys, __global uint* mover_ids,
+	__global uint* out_keys, __global uint* out_src_locations, __global uint* sort_state, __global uint* cell_starts) {
+	if(get_global_id(0) >= fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	if(!sort_state[0]) {
+		const uint key = stay_keys[self_id];
+		const uint dst_loc = cell_starts[key] + moved_flags[self_id];
+		out_keys[dst_loc] = key;
+		out_src_locations[dst_loc] = self_id;
 		return;
+	}
 
-	// load src position
-	uint src_loc = src_locations[dst_loc];
+	const uint mover_count = mover_offsets[fluid_count];
+	const uint stay_count = fluid_count - mover_count;
 
-	// reorder all attributes
-	// -> positions
-	vstore3(vload3(src_loc, in_positions), dst_loc, out_positions);
-	// -> velocities
-	vstore3(vload3(src_loc, in_velocities), dst_loc, out_velocities);
+	// -> remaining particle
+	if(!moved_flags[self_id]) {
+		const uint stay_i = self_id - mover_offsets[self_id];
+		const uint key = stay_keys[stay_i];
+		const uint dst_loc = stay_i + count_sorted_keys(mover_keys, mover_count, key, true);
+		out_keys[dst_loc] = key;
+		out_src_locations[dst_loc] = self_id;
+	}
 
-	// calculate offset
-	uint cur_key = fluid_keys[dst_loc];
-	// -> cur_key != prev_key => cell start
-	if(dst_loc == 0 || cur_key != fluid_keys[dst_loc - 1]) {
-		cell_offsets[2 * cur_key + 0] = dst_loc;
+	// -> mover
+	if(self_id < mover_count) {
+		const uint key = mover_keys[self_id];
+		const uint dst_loc = self_id + count_sorted_keys(stay_keys, stay_count, key, false);
+		out_keys[dst_loc] = key;
+		out_src_locations[dst_loc] = mover_ids[self_id];
 	}
-	// -> cur_key != next_key => cell end
-	if(dst_loc == fluid_count - 1 || cur_key != fluid_keys[dst_loc + 1]) {
-		cell_offsets[2 * cur_key + 1] = dst_loc + 1;
+}
+
+// occupied cells of the sorted fluid particles (work-group per cell, see FOREACH_OCCUPIED_CELL_CHUNK).
+// cell_flags has fluid_capacity + 1 entries, the exclusive scan of the flags (clogs) gives the index of every occupied cell
+// (the entries behind the active count don't affect the first fluid_count + 1 results)
+__kernel void flag_occupied_cells(__constant Simulation_Params* params, __global float* fluid_positions, __global uint* cell_offsets, __global uint* cell_flags) {
+	if(get_global_id(0) == 0)
+		cell_flags[params->fluid_count] = 0;
+	if(get_global_id(0) >= params->fluid_count) return;
+
+	// -> first particle of its cell
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	const uint key = get_cell_key(params, get_grid_cell_pos(params, self_pos));
+	cell_flags[self_id] = cell_offsets[2 * key] == self_id ? 1 : 0;
+}
+
+__kernel void compact_occupied_cells(__constant Simulation_Params* params, __global uint* cell_indices, __global uint* occupied_cells) {
+	if(get_global_id(0) >= params->fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	const uint cell_index = cell_indices[self_id];
+	if(cell_indices[self_id + 1] != cell_index)
+		occupied_cells[1 + cell_index] = self_id;
+
+	// -> cell count and the end of the last cell
+	if(self_id == 0) {
+		const uint cell_count = cell_indices[params->fluid_count];
+		occupied_cells[0] = cell_count;
+		occupied_cells[1 + cell_count] = params->fluid_count;
+	}
+}
+
+// collects all particles within the search radius (kernel radius + skin) from the grid
+// (other_count: capacity of other_positions, the fluid capacity or the boundary count).
+// a list which can't hold all neighbors is marked with NEIGHBOR_LIST_OVERFLOW (the particle searches the grid instead),
+// out_required_size keeps the largest list size needed so far (read by the host to grow the lists)
+__kernel void build_neighbor_lists(__constant Simulation_Params* params, float search_radius2, 
+	__global float* fluid_positions, __global uint* cell_offsets, __global float* other_positions, __global uint* out_neighbor_lists, uint other_count,
+	__global uint* out_required_size) {
+	if(get_global_id(0) >= params->fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	__global uint* neighbor_list = out_neighbor_lists + self_id * NEIGHBOR_LIST_SIZE;
+
+	uint neighbor_count = 0;
+	FOREACH_NEIGHBOR(params, cell_offsets, self_pos, {
+		float3 diff = self_pos - LOAD_PARTICLE_POS(params, other_id, other_positions, other_count);
+		if(dot(diff, diff) <= search_radius2) {
+			neighbor_count++;
+			if(neighbor_count < NEIGHBOR_LIST_SIZE)
+				neighbor_list[neighbor_count] = other_id;
+		}
+	});
+
+	if(neighbor_count >= NEIGHBOR_LIST_SIZE) {
+		neighbor_list[0] = NEIGHBOR_LIST_OVERFLOW;
+		atomic_max(out_required_size, neighbor_count + 1);
+	}
+	else
+		neighbor_list[0] = neighbor_count;
+}
+
+// stores the (start, end) offsets of the 27 neighbor cells so the following kernels don't have to hash them again
+__kernel void build_cell_ranges(__constant Simulation_Params* params, 
+	__global float* fluid_positions, __global uint* cell_offsets, __global uint* out_cell_ranges) {
+	if(get_global_id(0) >= params->fluid_count) return;
+
+	const uint self_id = get_global_id(0);
+	const float3 self_pos = LOAD_PARTICLE_POS(params, self_id, fluid_positions, params->fluid_capacity);
+	__global uint* self_cell_ranges = out_cell_ranges + self_id * 2 * 3 * 3 * 3;
+
+	int3 cell_pos = get_grid_cell_pos(params, self_pos);
+	for(int i = 0; i < 3 * 3 * 3; i++) {
+		int3 offset = { ((i / 1) % 3) - 1, ((i / 3) % 3) - 1, ((i / 9) % 3) - 1 };
+		int3 cur_cell_pos = cell_pos + offset;
+		// -> cells outside of a dense grid are stored as empty ranges
+		uint2 range = (uint2)(0, 0);
+		if(is_cell_in_grid(params, cur_cell_pos))
+			range = vload2(get_cell_key(params, cur_cell_pos), cell_offsets);
+		vstore2(range, i, self_cell_ranges);
 	}
 }
 
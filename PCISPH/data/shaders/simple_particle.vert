@@ -1,12 +1,17 @@
 #version 430
 
-in vec3 particle_pos; 
+// particle position components (see vis::render_fluid_simple)
+in float particle_pos_x; 
+in float particle_pos_y; 
+in float particle_pos_z; 
 //in vec3 particle_normal; 
 in vec3 pos; 
 in vec3 vert_normal; 
 in float color_factor;
 
 uniform mat4 trans;
+uniform vec3 particle_pos_origin;
+uniform float particle_pos_scale;
 uniform float particle_radius;
 uniform float color_factor_min;
 uniform float color_factor_neutral;
@@ -31,6 +36,7 @@ void main() {
 		diffuse_color = mix(min_color, neutral_color, f);
 	}
 	
+	vec3 particle_pos = particle_pos_origin + particle_pos_scale * vec3(particle_pos_x, particle_pos_y, particle_pos_z);
 	float scale = 1.0f;
 	frag_normal = vert_normal;
 	//frag_normal = particle_normal;
@@ -0,0 +1,41 @@
+# generates src/sim/embedded_kernels.h from data/kernels (compile with -DEMBEDDED_KERNELS to use it, see sim/program_cache.cpp).
+# run it from the PCISPH directory after changing a kernel
+import os
+
+KERNEL_DIRECTORY = "data/kernels"
+OUTPUT = "src/sim/embedded_kernels.h"
+# string literals are limited to 16380 bytes by msvc
+PART_SIZE = 8000
+DELIMITER = "PCISPH_KERNEL"
+
+def split_source(source):
+	parts = [""]
+	for line in source.splitlines(True):
+		if len(parts[-1]) + len(line) > PART_SIZE:
+			parts.append("")
+		parts[-1] += line
+	return parts
+
+def main():
+	names = sorted(name for name in os.listdir(KERNEL_DIRECTORY) if name.endswith((".cl", ".h")))
+	lines = ["// generated by embed_kernels.py, do not edit", ""]
+	for i, name in enumerate(names):
+		with open(os.path.join(KERNEL_DIRECTORY, name), newline="") as file:
+			source = file.read().replace("\r\n", "\n")
+		if ")" + DELIMITER + "\"" in source:
+			raise RuntimeError(name + " contains the raw string delimiter")
+		lines.append("const char* const embedded_kernel_%d[] = {" % i)
+		for part in split_source(source):
+			lines.append("R\"%s(%s)%s\"," % (DELIMITER, part, DELIMITER))
+		lines.append("nullptr };")
+	lines.append("")
+	lines.append("const Embedded_Kernel embedded_kernels[] = {")
+	for i, name in enumerate(names):
+		lines.append("\t{ \"%s/%s\", embedded_kernel_%d }," % (KERNEL_DIRECTORY, name, i))
+	lines.append("};")
+
+	with open(OUTPUT, "w", newline="\n") as file:
+		file.write("\n".join(lines) + "\n")
+
+if __name__ == "__main__":
+	main()
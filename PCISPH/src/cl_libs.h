@@ -0,0 +1,12 @@
+#pragma once
+
+#ifndef __CL_ENABLE_EXCEPTIONS
+#define __CL_ENABLE_EXCEPTIONS
+#endif
+#ifndef CL_USE_DEPRECATED_OPENCL_1_1_APIS
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+#endif
+
+#pragma warning(push, 0) 
+#include <CL/cl.hpp>
+#pragma warning(pop)
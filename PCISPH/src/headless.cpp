@@ -0,0 +1,675 @@
+#include "scenes_host.h"
+#include "sim/Fluid.h"
+#include "sim/program_cache.h"
+#include "sim/local_size_tuning.h"
+#include <cl_libs.h>
+
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <chrono>
+#include <iostream>
+
+struct Run_Result {
+	float simulation_time;
+	unsigned int step_count;
+	unsigned int iteration_count;
+	unsigned int kernel_launches;
+	float wall_time_ms;
+	// startup stages: fluid creation and scene generation (the programs are compiled concurrently), waiting for the programs
+	// (compiled or loaded from the program cache) and the buffers, first step (or batch) including its synchronization
+	float scene_ms;
+	float compile_wait_ms;
+	float first_step_ms;
+	sim::Program_Cache_Statistics program_statistics;
+	float cache_lines_per_particle;
+	float particle_bandwidth;
+	std::string particle_layout;
+	sim::Sort_Statistics sort_statistics;
+	sim::Solver_Statistics solver_statistics;
+	unsigned int neighbor_list_size;
+	// final active count and capacity (particle flow)
+	bool particle_flow;
+	unsigned int fluid_count;
+	unsigned int fluid_capacity;
+};
+
+// memory locality of the particle order: average number of distinct 64 byte cache lines of the position buffer
+// which are touched by the neighbors (within the kernel radius) of a particle
+float measure_cache_lines_per_particle(sim::Fluid& fluid) {
+	const auto& params = fluid.get_params();
+	if(params.fluid_count == 0)
+		return 0.f;
+
+	// -> the buffer holds fluid_capacity particles, the active ones are at the front
+	std::vector<std::uint8_t> layout_positions(params.fluid_capacity * fluid.get_particle_vec_size());
+	fluid.queue.enqueueReadBuffer(fluid.fluid_positions, CL_TRUE, 0, layout_positions.size(), layout_positions.data());
+	const auto positions = fluid.from_particle_layout(layout_positions, true);
+
+	auto cell_of = [&](std::size_t i, int axis) {
+		return (std::int64_t) std::floor(positions[3 * i + axis] / params.kernel_radius);
+	};
+	auto cell_key = [](std::int64_t x, std::int64_t y, std::int64_t z) {
+		return ((x & 0x1FFFFF) << 42) | ((y & 0x1FFFFF) << 21) | (z & 0x1FFFFF);
+	};
+
+	std::unordered_map<std::int64_t, std::vector<std::uint32_t>> cells;
+	for(std::uint32_t i = 0; i < params.fluid_count; i++)
+		cells[cell_key(cell_of(i, 0), cell_of(i, 1), cell_of(i, 2))].push_back(i);
+
+	// -> cache lines of the x components (the other components are in the same line except for the SoA layout)
+	const std::size_t cache_line_size = 64;
+	std::size_t cache_line_count = 0;
+	for(std::uint32_t i = 0; i < params.fluid_count; i++) {
+		std::set<std::size_t> cache_lines;
+		for(int z = -1; z <= 1; z++) {
+			for(int y = -1; y <= 1; y++) {
+				for(int x = -1; x <= 1; x++) {
+					auto cell = cells.find(cell_key(cell_of(i, 0) + x, cell_of(i, 1) + y, cell_of(i, 2) + z));
+					if(cell == cells.end())
+						continue;
+					for(auto other : cell->second) {
+						float r2 = 0.f;
+						for(int axis = 0; axis < 3; axis++)
+							r2 += std::pow(positions[3 * i + axis] - positions[3 * other + axis], 2.f);
+						if(r2 <= params.kernel_radius2)
+							cache_lines.insert(fluid.get_particle_vec_offset(params.fluid_capacity, other, 0) / cache_line_size);
+					}
+				}
+			}
+		}
+		cache_line_count += cache_lines.size();
+	}
+	return (float) cache_line_count / params.fluid_count;
+}
+
+// effective bandwidth (GB/s) of the particle vector layout: streams the fluid positions and velocities like the time integration.
+// the bandwidth is given in float3 data, the padding of the float4 layout is overhead and the compressed storage is a gain.
+// the whole capacity of the buffers is streamed (SoA plane size)
+float measure_particle_bandwidth(sim::Fluid& fluid) {
+	const auto count = fluid.get_params().fluid_capacity;
+	if(count == 0)
+		return 0.f;
+
+	cl::Program program;
+	try {
+		sim::build_cached_program(fluid.ctx, fluid.device, sim::load_kernel_source("data/kernels/benchmark_utils.cl"), fluid.get_build_params(), program);
+	}
+	catch(cl::Error&) {
+		std::cout << "benchmark_utils program failed to build" << std::endl;
+		std::cout << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(fluid.device) << std::endl;
+		std::getchar();
+		std::rethrow_exception(std::current_exception());
+	}
+
+	cl::Buffer out_positions(fluid.ctx, CL_MEM_READ_WRITE, count * fluid.get_particle_vec_size());
+	cl::Kernel stream_kernel(program, "stream_particle_vectors");
+	stream_kernel.setArg(0, (cl_uint) count);
+	stream_kernel.setArg(1, fluid.fluid_positions);
+	stream_kernel.setArg(2, fluid.fluid_velocities);
+	stream_kernel.setArg(3, out_positions);
+
+	const unsigned int repetitions = 20;
+	double duration_ns = 0.0;
+	for(unsigned int i = 0; i < repetitions; i++) {
+		cl::Event event;
+		fluid.queue.enqueueNDRangeKernel(stream_kernel, cl::NullRange, cl::NDRange(count), cl::NullRange, nullptr, &event);
+		event.wait();
+		duration_ns += event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	}
+	const double bytes = 3.0 * 3 * sizeof(float) * count * repetitions;
+	return duration_ns > 0.0 ? (float) (bytes / duration_ns) : 0.f;
+}
+
+// advances the fluid by the given duration (in batches of steps if batch_size > 0)
+void simulate(sim::Fluid& fluid, float simulation_duration, unsigned int batch_size, Run_Result& result) {
+	const auto first_step_start = std::chrono::high_resolution_clock::now();
+	bool first_step = true;
+	while(result.simulation_time < simulation_duration) {
+		if(batch_size > 0) {
+			fluid.advance(batch_size);
+			result.simulation_time += batch_size * fluid.get_params().delta_t;
+			result.step_count += batch_size;
+			for(auto iterations : fluid.get_step_iterations())
+				result.iteration_count += iterations;
+			result.kernel_launches += fluid.get_solver_statistics().kernel_launches;
+		}
+		else {
+			fluid.update();
+			result.simulation_time += fluid.get_params().delta_t;
+			result.step_count++;
+			result.iteration_count += fluid.get_solver_statistics().iterations;
+			result.kernel_launches += fluid.get_solver_statistics().kernel_launches;
+		}
+
+		if(first_step) {
+			fluid.queue.finish();
+			result.first_step_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - first_step_start).count();
+			first_step = false;
+		}
+	}
+}
+
+// applies the configuration to a new fluid, loads the scene and simulates the given duration
+Run_Result run_simulation(cl::Context& cl_ctx, cl::Device& device, cl::CommandQueue& cl_queue, const std::string& scene_name,
+                          float simulation_duration, unsigned int batch_size, const std::function<void(sim::Fluid&)>& configure) {
+	Run_Result result = {};
+	sim::reset_program_cache_statistics();
+	auto scene_start = std::chrono::high_resolution_clock::now();
+	sim::Fluid fluid(cl_ctx, device, cl_queue);
+	configure(fluid);
+	scene::load_headless(scene_name, fluid);
+	cl_queue.finish();
+	auto compile_wait_start = std::chrono::high_resolution_clock::now();
+	fluid.prepare();
+	cl_queue.finish();
+	auto compile_wait_end = std::chrono::high_resolution_clock::now();
+	result.scene_ms = std::chrono::duration<float, std::milli>(compile_wait_start - scene_start).count();
+	result.compile_wait_ms = std::chrono::duration<float, std::milli>(compile_wait_end - compile_wait_start).count();
+	result.program_statistics = sim::get_program_cache_statistics();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	simulate(fluid, simulation_duration, batch_size, result);
+	cl_queue.finish();
+	auto end = std::chrono::high_resolution_clock::now();
+	result.wall_time_ms = std::chrono::duration<float, std::milli>(end - start).count();
+	result.cache_lines_per_particle = measure_cache_lines_per_particle(fluid);
+	result.particle_bandwidth = measure_particle_bandwidth(fluid);
+	result.particle_layout = fluid.get_particle_layout_name();
+	result.sort_statistics = fluid.get_sort_statistics();
+	result.solver_statistics = fluid.get_solver_statistics();
+	result.neighbor_list_size = fluid.get_neighbor_list_size();
+	result.particle_flow = fluid.uses_particle_flow();
+	result.fluid_count = fluid.get_params().fluid_count;
+	result.fluid_capacity = fluid.get_params().fluid_capacity;
+
+	return result;
+}
+
+// measures the kernel times of the scene for every candidate work-group size and stores the fastest size per kernel
+// in the tuning database of the device (sim::local_size_database_path)
+void tune_local_sizes(cl::Context& cl_ctx, cl::Device& device, cl::CommandQueue& cl_queue, const std::string& scene_name,
+                      float simulation_duration, unsigned int batch_size, const std::function<void(sim::Fluid&)>& configure) {
+	const std::uint32_t min_local_size = 16;
+	const std::uint32_t max_local_size = std::min((std::uint32_t) 1024, (std::uint32_t) device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+
+	// kernel -> local size -> device time per launch (a kernel may run with a smaller size than the candidate, see Fluid::set_local_sizes)
+	std::map<std::string, std::map<std::uint32_t, double>> times;
+	for(std::uint32_t candidate = min_local_size; candidate <= max_local_size; candidate *= 2) {
+		std::cout << "[local size " << candidate << "]" << std::endl;
+		sim::Fluid fluid(cl_ctx, device, cl_queue);
+		configure(fluid);
+		fluid.set_local_sizes({});
+		fluid.set_default_local_size(candidate);
+		fluid.set_kernel_profiling(true);
+		scene::load_headless(scene_name, fluid);
+
+		Run_Result result = {};
+		simulate(fluid, simulation_duration, batch_size, result);
+		for(const auto& kernel : fluid.get_kernel_profile()) {
+			if(kernel.second.launches > 0)
+				times[kernel.first].emplace(kernel.second.local_size, kernel.second.time_ms / kernel.second.launches);
+		}
+	}
+
+	sim::Local_Sizes best_local_sizes;
+	std::cout << "Work-group sizes (device time per launch):" << std::endl;
+	for(const auto& kernel : times) {
+		auto best = std::min_element(kernel.second.begin(), kernel.second.end(), [](const std::pair<const std::uint32_t, double>& a, const std::pair<const std::uint32_t, double>& b) {
+			return a.second < b.second;
+		});
+		best_local_sizes[kernel.first] = best->first;
+		std::cout << "-> " << kernel.first << ":";
+		for(const auto& time : kernel.second)
+			std::cout << " " << time.first << " (" << time.second * 1000.0 << "us)";
+		std::cout << " -> " << best->first << std::endl;
+	}
+	sim::store_local_sizes(device, best_local_sizes, sim::local_size_database_path);
+	std::cout << "Stored in " << sim::local_size_database_path << std::endl;
+}
+
+// momentum balance of the fluid-fluid forces after simulating the scene with the given configuration
+sim::Force_Balance run_conservation_check(cl::Context& cl_ctx, cl::Device& device, cl::CommandQueue& cl_queue, const std::string& scene_name,
+                                          float simulation_duration, unsigned int batch_size, const std::function<void(sim::Fluid&)>& configure) {
+	sim::Fluid fluid(cl_ctx, device, cl_queue);
+	configure(fluid);
+	scene::load_headless(scene_name, fluid);
+
+	Run_Result result = {};
+	simulate(fluid, simulation_duration, batch_size, result);
+	return fluid.measure_force_balance();
+}
+
+void print_force_balance(const std::string& name, const sim::Force_Balance& balance) {
+	std::cout << "[" << name << "]" << std::endl;
+	std::cout << "-> Pressure forces |sum| / sum |f|: " << balance.pressure_imbalance << std::endl;
+	std::cout << "-> Viscosity + surface tension |sum| / sum |f|: " << balance.other_imbalance << std::endl;
+}
+
+// particle state of a validation run, indexed by the initial particle order
+struct Validation_State {
+	std::vector<float> positions;
+	std::vector<float> velocities;
+	float mean_density;
+	float iterations_per_step;
+	std::size_t particle_vec_size;
+	float particle_radius;
+};
+
+template<typename T>
+std::vector<T> read_buffer(sim::Fluid& fluid, const cl::Buffer& buffer, std::size_t count) {
+	std::vector<T> result(count);
+	fluid.queue.enqueueReadBuffer(buffer, CL_TRUE, 0, count * sizeof(T), result.data());
+	return result;
+}
+
+// simulates the scene and tracks the particles with a persistent id attribute (the particles are reordered in every step)
+Validation_State run_validation(cl::Context& cl_ctx, cl::Device& device, cl::CommandQueue& cl_queue, const std::string& scene_name,
+                                float simulation_duration, unsigned int batch_size, const std::function<void(sim::Fluid&)>& configure) {
+	sim::Fluid fluid(cl_ctx, device, cl_queue);
+	configure(fluid);
+	scene::load_headless(scene_name, fluid);
+
+	const auto count = fluid.get_params().fluid_count;
+	const auto ids_attribute = fluid.add_attribute({ "ids", sim::Attribute_Type::UINT, 1, true });
+	std::vector<std::uint32_t> initial_ids(count);
+	for(cl_uint i = 0; i < count; i++)
+		initial_ids[i] = i;
+	cl_queue.enqueueWriteBuffer(fluid.get_attribute_buffer(ids_attribute), CL_TRUE, 0, count * sizeof(cl_uint), initial_ids.data());
+
+	Run_Result result = {};
+	simulate(fluid, simulation_duration, batch_size, result);
+	cl_queue.finish();
+
+	// -> the particle vectors are read with the capacity of the buffers (SoA plane size)
+	const auto capacity = fluid.get_params().fluid_capacity;
+	const auto ids = read_buffer<cl_uint>(fluid, fluid.get_attribute_buffer(ids_attribute), count);
+	const auto positions = fluid.from_particle_layout(read_buffer<std::uint8_t>(fluid, fluid.fluid_positions, capacity * fluid.get_particle_vec_size()), true);
+	const auto velocities = fluid.from_particle_layout(read_buffer<std::uint8_t>(fluid, fluid.fluid_velocities, capacity * fluid.get_particle_vec_size()), false);
+	const auto densities = read_buffer<float>(fluid, fluid.fluid_densities, count);
+
+	Validation_State state;
+	state.positions.resize(3 * count);
+	state.velocities.resize(3 * count);
+	for(std::size_t i = 0; i < count; i++) {
+		for(int axis = 0; axis < 3; axis++) {
+			state.positions[3 * ids[i] + axis] = positions[3 * i + axis];
+			state.velocities[3 * ids[i] + axis] = velocities[3 * i + axis];
+		}
+	}
+	double density_sum = 0.0;
+	for(auto density : densities)
+		density_sum += density;
+	state.mean_density = count > 0 ? (float) (density_sum / count) : 0.f;
+	state.iterations_per_step = result.step_count > 0 ? (float) result.iteration_count / result.step_count : 0.f;
+	state.particle_vec_size = fluid.get_particle_vec_size();
+	state.particle_radius = fluid.get_params().particle_radius;
+	return state;
+}
+
+// densities of the first step (the scene at rest) in the sorted particle order. the radix sort is stable, so runs of the same
+// scene with different neighbor searches have the same particle order
+std::vector<float> run_first_step_densities(cl::Context& cl_ctx, cl::Device& device, cl::CommandQueue& cl_queue, const std::string& scene_name,
+                                            const std::function<void(sim::Fluid&)>& configure) {
+	sim::Fluid fluid(cl_ctx, device, cl_queue);
+	configure(fluid);
+	fluid.set_sort_method(sim::Sort_Method::RADIX);
+	scene::load_headless(scene_name, fluid);
+	fluid.update();
+	cl_queue.finish();
+	return read_buffer<float>(fluid, fluid.fluid_densities, fluid.get_params().fluid_count);
+}
+
+// compares the densities of the neighbor lists with the grid search for a default and a large skin.
+// returns false if a density differs by more than float rounding
+bool check_neighbor_lists(cl::Context& cl_ctx, cl::Device& device, cl::CommandQueue& cl_queue, const std::string& scene_name,
+                          const std::function<void(sim::Fluid&)>& configure) {
+	const float tolerance = 1e-4f;
+	const auto reference = run_first_step_densities(cl_ctx, device, cl_queue, scene_name,
+		[&](sim::Fluid& fluid) { configure(fluid); fluid.set_neighbor_search(sim::Neighbor_Search::GRID); });
+
+	bool passed = true;
+	std::cout << "Densities of the neighbor lists against the grid search (first step):" << std::endl;
+	for(float skin : { 0.2f, 0.5f }) {
+		std::uint32_t list_size = 0;
+		const auto densities = run_first_step_densities(cl_ctx, device, cl_queue, scene_name, [&](sim::Fluid& fluid) {
+			configure(fluid);
+			fluid.set_neighbor_search(sim::Neighbor_Search::NEIGHBOR_LIST);
+			fluid.set_neighbor_list_skin(skin);
+			list_size = fluid.get_neighbor_list_size();
+		});
+
+		float max_difference = densities.size() == reference.size() ? 0.f : std::numeric_limits<float>::infinity();
+		for(std::size_t i = 0; i < std::min(densities.size(), reference.size()); i++)
+			max_difference = std::max(max_difference, std::abs(densities[i] - reference[i]) / std::max(std::abs(reference[i]), 1e-6f));
+		const bool matches = max_difference <= tolerance;
+		passed = passed && matches;
+		std::cout << "[skin " << skin << ", " << list_size << " entries per list]" << std::endl;
+		std::cout << "-> Max relative density difference: " << max_difference << (matches ? "" : " (MISMATCH)") << std::endl;
+	}
+	return passed;
+}
+
+// compares a compressed storage run with a full precision run of the same scene
+void print_validation_report(const Validation_State& reference, const Validation_State& compressed) {
+	const std::size_t count = reference.positions.size() / 3;
+	double position_error_sum = 0.0;
+	double max_position_error = 0.0;
+	double velocity_error_sum = 0.0;
+	double velocity_sum = 0.0;
+	double reference_energy = 0.0;
+	double compressed_energy = 0.0;
+	for(std::size_t i = 0; i < count; i++) {
+		double position_error2 = 0.0;
+		double velocity_error2 = 0.0;
+		double reference_velocity2 = 0.0;
+		double compressed_velocity2 = 0.0;
+		for(std::size_t axis = 0; axis < 3; axis++) {
+			position_error2 += std::pow(reference.positions[3 * i + axis] - compressed.positions[3 * i + axis], 2.0);
+			velocity_error2 += std::pow(reference.velocities[3 * i + axis] - compressed.velocities[3 * i + axis], 2.0);
+			reference_velocity2 += std::pow(reference.velocities[3 * i + axis], 2.0);
+			compressed_velocity2 += std::pow(compressed.velocities[3 * i + axis], 2.0);
+		}
+		position_error_sum += std::sqrt(position_error2);
+		max_position_error = std::max(max_position_error, std::sqrt(position_error2));
+		velocity_error_sum += std::sqrt(velocity_error2);
+		velocity_sum += std::sqrt(reference_velocity2);
+		reference_energy += reference_velocity2;
+		compressed_energy += compressed_velocity2;
+	}
+
+	auto relative = [](double value, double reference_value) {
+		return reference_value != 0.0 ? (float) (value / reference_value) : 0.f;
+	};
+	std::cout << "Validation of the compressed storage against full float precision:" << std::endl;
+	std::cout << "-> Bytes per particle vector: " << compressed.particle_vec_size << " (full precision: " << reference.particle_vec_size << ")" << std::endl;
+	std::cout << "-> Position error (particle radii): mean " << relative(position_error_sum / std::max<std::size_t>(count, 1), reference.particle_radius)
+		<< ", max " << relative(max_position_error, reference.particle_radius) << std::endl;
+	std::cout << "-> Velocity error (relative to the mean speed): " << relative(velocity_error_sum, velocity_sum) << std::endl;
+	std::cout << "-> Kinetic energy (relative): " << relative(compressed_energy, reference_energy) << std::endl;
+	std::cout << "-> Mean density: " << compressed.mean_density << " (full precision: " << reference.mean_density << ")" << std::endl;
+	std::cout << "-> PCISPH iterations per step: " << compressed.iterations_per_step << " (full precision: " << reference.iterations_per_step << ")" << std::endl;
+}
+
+void print_result(const Run_Result& result) {
+	std::cout << "Simulated " << result.simulation_time << "s in " << result.step_count << " steps" << std::endl;
+	std::cout << "-> Startup: scene generation " << result.scene_ms << "ms, waiting for the programs " << result.compile_wait_ms << "ms, first step " << result.first_step_ms << "ms" << std::endl;
+	std::cout << "-> Programs compiled / loaded from the cache: " << result.program_statistics.compiled_programs << " (" << result.program_statistics.compile_ms << "ms) / "
+		<< result.program_statistics.loaded_programs << " (" << result.program_statistics.load_ms << "ms)" << std::endl;
+	std::cout << "-> Wall time: " << result.wall_time_ms << "ms" << std::endl;
+	std::cout << "-> Per step: " << (result.step_count > 0 ? result.wall_time_ms / result.step_count : 0.f) << "ms" << std::endl;
+	std::cout << "-> PCISPH iterations per step: " << (result.step_count > 0 ? (float) result.iteration_count / result.step_count : 0.f) << std::endl;
+	std::cout << "-> PCISPH kernel launches per step: " << (result.step_count > 0 ? (float) result.kernel_launches / result.step_count : 0.f) << std::endl;
+	std::cout << "-> Neighbor cache lines per particle: " << result.cache_lines_per_particle << std::endl;
+	std::cout << "-> Particle vector bandwidth (" << result.particle_layout << " layout): " << result.particle_bandwidth << "GB/s" << std::endl;
+	if(result.particle_flow)
+		std::cout << "-> Fluid particles / capacity: " << result.fluid_count << " / " << result.fluid_capacity << std::endl;
+	if(result.solver_statistics.neighbor_list_growths > 0)
+		std::cout << "-> Neighbor lists grown after an overflow: " << result.solver_statistics.neighbor_list_growths << " (" << result.neighbor_list_size << " entries)" << std::endl;
+	if(result.solver_statistics.cell_tiles_unsupported)
+		std::cout << "-> Work-group per cell kernels not supported by the device, one work-item per particle was used" << std::endl;
+
+	const auto& sort_statistics = result.sort_statistics;
+	if(sort_statistics.full_sorts + sort_statistics.incremental_sorts > 0) {
+		std::cout << "-> Full / incremental sorts: " << sort_statistics.full_sorts << " / " << sort_statistics.incremental_sorts << std::endl;
+		std::cout << "-> Moved particles per incremental sort: " 
+			<< (sort_statistics.incremental_sorts > 0 ? (float) sort_statistics.moved_particles / sort_statistics.incremental_sorts : 0.f) << std::endl;
+	}
+}
+
+// headless simulation runner: no window, no gl context and no gl interop.
+// works with every OpenCL device (including CPU implementations).
+int main(int argc, char** argv) {
+	std::string scene_name;
+	float simulation_duration = 1.f;
+	int device_index = 0;
+	bool pipelined_convergence_check = false;
+	// 0: cold pressure start
+	float pressure_warm_start = 0.f;
+	unsigned int batch_size = 0;
+	sim::Neighbor_Search neighbor_search = sim::Neighbor_Search::GRID;
+	sim::Grid_Type grid_type = sim::Grid_Type::HASHED;
+	sim::Cell_Ordering cell_ordering = sim::Cell_Ordering::LINEAR;
+	sim::Sort_Method sort_method = sim::Sort_Method::RADIX;
+	bool compressed_storage = false;
+	sim::Kernel_Fusion kernel_fusion = sim::Kernel_Fusion::NONE;
+	sim::Work_Distribution work_distribution = sim::Work_Distribution::PER_PARTICLE;
+	sim::Pair_Evaluation pair_evaluation = sim::Pair_Evaluation::FULL;
+	bool program_specialization = true;
+	bool check_conservation = false;
+	bool benchmark = false;
+	bool validate = false;
+	bool neighbor_list_check = false;
+	bool tune = false;
+
+	// parse arguments
+	auto get_arg = [&](int i) -> std::string {
+		if(i >= argc || i < 0)
+			return "";
+		return argv[i];
+	};
+
+	int current_arg_i = 1;
+	std::map<std::string, std::function<void()>> params_mapping;
+	params_mapping["-i"] = [&]() {
+		scene_name = get_arg(current_arg_i++);
+	};
+	params_mapping["-d"] = [&]() {
+		simulation_duration = 0.001f * std::stoi(get_arg(current_arg_i++));
+	};
+	params_mapping["-device"] = [&]() {
+		device_index = std::stoi(get_arg(current_arg_i++));
+	};
+	params_mapping["-pipelined"] = [&]() {
+		pipelined_convergence_check = true;
+	};
+	params_mapping["-warm_start"] = [&]() {
+		pressure_warm_start = std::stof(get_arg(current_arg_i++));
+	};
+	params_mapping["-batch"] = [&]() {
+		batch_size = std::stoi(get_arg(current_arg_i++));
+	};
+	params_mapping["-neighbor_list"] = [&]() {
+		neighbor_search = sim::Neighbor_Search::NEIGHBOR_LIST;
+	};
+	params_mapping["-cell_ranges"] = [&]() {
+		neighbor_search = sim::Neighbor_Search::CELL_RANGES;
+	};
+	params_mapping["-dense_grid"] = [&]() {
+		grid_type = sim::Grid_Type::DENSE;
+	};
+	params_mapping["-morton"] = [&]() {
+		cell_ordering = sim::Cell_Ordering::MORTON;
+	};
+	params_mapping["-counting_sort"] = [&]() {
+		sort_method = sim::Sort_Method::COUNTING;
+	};
+	params_mapping["-incremental_sort"] = [&]() {
+		sort_method = sim::Sort_Method::INCREMENTAL;
+	};
+	params_mapping["-compressed"] = [&]() {
+		compressed_storage = true;
+	};
+	params_mapping["-fused"] = [&]() {
+		kernel_fusion = sim::Kernel_Fusion::PREDICT_WITH_FORCES;
+	};
+	params_mapping["-fused_on_the_fly"] = [&]() {
+		kernel_fusion = sim::Kernel_Fusion::PREDICT_ON_THE_FLY;
+	};
+	params_mapping["-cell_tiles"] = [&]() {
+		work_distribution = sim::Work_Distribution::PER_CELL;
+	};
+	params_mapping["-symmetric"] = [&]() {
+		pair_evaluation = sim::Pair_Evaluation::SYMMETRIC;
+	};
+	params_mapping["-no_program_cache"] = [&]() {
+		sim::set_program_cache_directory("");
+	};
+	params_mapping["-generic"] = [&]() {
+		program_specialization = false;
+	};
+	params_mapping["-conservation"] = [&]() {
+		check_conservation = true;
+	};
+	params_mapping["-benchmark"] = [&]() {
+		benchmark = true;
+	};
+	params_mapping["-tune"] = [&]() {
+		tune = true;
+	};
+	params_mapping["-validate"] = [&]() {
+		validate = true;
+	};
+	params_mapping["-check_neighbor_lists"] = [&]() {
+		neighbor_list_check = true;
+	};
+
+	while(current_arg_i < argc) {
+		auto v = get_arg(current_arg_i++);
+		if(!params_mapping.count(v)) {
+			std::cout << "Invalid argument: " << v << std::endl;
+			return -1;
+		}
+		params_mapping[v]();
+	}
+
+	if(scene_name.empty()) {
+		std::cout << "-i <scene_name> [-d <duration_ms>] [-device <index>] [-pipelined] [-warm_start <factor>] [-batch <steps>] [-neighbor_list] [-cell_ranges] [-dense_grid] [-morton] [-counting_sort] [-incremental_sort] [-compressed] [-fused] [-fused_on_the_fly] [-cell_tiles] [-symmetric] [-generic] [-no_program_cache] [-benchmark] [-validate] [-conservation] [-check_neighbor_lists] [-tune]" << std::endl;
+		return -1;
+	}
+
+	try {
+		/////////////////
+		// OpenCL init //
+		auto context_start = std::chrono::high_resolution_clock::now();
+		std::vector<cl::Device> all_devices;
+		std::vector<cl::Platform> platforms;
+		cl::Platform::get(&platforms);
+		for(auto& platform : platforms) {
+			std::vector<cl::Device> devices;
+			try {
+				platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+			}
+			catch(cl::Error&) {
+				continue;
+			}
+			all_devices.insert(all_devices.end(), devices.begin(), devices.end());
+		}
+
+		for(std::size_t i = 0; i < all_devices.size(); i++)
+			std::cout << "[" << i << "] " << all_devices[i].getInfo<CL_DEVICE_NAME>() << std::endl;
+
+		if(device_index < 0 || device_index >= (int) all_devices.size()) {
+			std::cout << "Couldn't find OpenCL device " << device_index << std::endl;
+			return -1;
+		}
+
+		cl::Device device = all_devices[device_index];
+		cl::Context cl_ctx({ device });
+		cl::CommandQueue cl_queue = cl::CommandQueue(cl_ctx, device, CL_QUEUE_PROFILING_ENABLE);
+		std::cout << "Using device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+		std::cout << "Context creation: " << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - context_start).count() << "ms" << std::endl;
+
+		auto configure = [&](sim::Fluid& fluid) {
+			fluid.set_pipelined_convergence_check(pipelined_convergence_check);
+			fluid.set_pressure_warm_start(pressure_warm_start);
+			fluid.set_neighbor_search(neighbor_search);
+			fluid.set_grid_type(grid_type);
+			fluid.set_cell_ordering(cell_ordering);
+			fluid.set_sort_method(sort_method);
+			fluid.set_compressed_storage(compressed_storage);
+			fluid.set_kernel_fusion(kernel_fusion);
+			fluid.set_work_distribution(work_distribution);
+			fluid.set_pair_evaluation(pair_evaluation);
+			fluid.set_program_specialization(program_specialization);
+		};
+
+		if(validate) {
+			auto reference = run_validation(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size, 
+				[&](sim::Fluid& fluid) { configure(fluid); fluid.set_compressed_storage(false); });
+			auto compressed = run_validation(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size, 
+				[&](sim::Fluid& fluid) { configure(fluid); fluid.set_compressed_storage(true); });
+			print_validation_report(reference, compressed);
+			return 0;
+		}
+
+		if(neighbor_list_check)
+			return check_neighbor_lists(cl_ctx, device, cl_queue, scene_name, configure) ? 0 : 1;
+
+		if(tune) {
+			tune_local_sizes(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size, configure);
+			return 0;
+		}
+
+		if(check_conservation) {
+			std::cout << "Momentum balance of the fluid-fluid forces:" << std::endl;
+			print_force_balance("full evaluation", run_conservation_check(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size,
+				[&](sim::Fluid& fluid) { configure(fluid); fluid.set_pair_evaluation(sim::Pair_Evaluation::FULL); }));
+			print_force_balance("symmetric pairs", run_conservation_check(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size,
+				[&](sim::Fluid& fluid) { configure(fluid); fluid.set_pair_evaluation(sim::Pair_Evaluation::SYMMETRIC); }));
+			return 0;
+		}
+
+		if(!benchmark) {
+			print_result(run_simulation(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size, configure));
+			return 0;
+		}
+
+		///////////////
+		// Benchmark //
+		// every variant simulates the same scene and duration, the other settings are shared.
+		// the particle layout is selected at compile time (PARTICLE_LAYOUT), compare builds for the bandwidth per layout
+		std::vector<std::pair<std::string, std::function<void(sim::Fluid&)>>> variants = {
+			{ "grid search", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_neighbor_search(sim::Neighbor_Search::GRID); } },
+			{ "neighbor lists", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_neighbor_search(sim::Neighbor_Search::NEIGHBOR_LIST); } },
+			{ "cell ranges", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_neighbor_search(sim::Neighbor_Search::CELL_RANGES); } },
+			{ "hashed grid", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_grid_type(sim::Grid_Type::HASHED); } },
+			{ "dense grid", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_grid_type(sim::Grid_Type::DENSE); } },
+			{ "linear cell order", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_cell_ordering(sim::Cell_Ordering::LINEAR); } },
+			{ "morton cell order", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_cell_ordering(sim::Cell_Ordering::MORTON); } },
+			{ "radix sort", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_sort_method(sim::Sort_Method::RADIX); } },
+			{ "counting sort", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_sort_method(sim::Sort_Method::COUNTING); } },
+			{ "incremental sort", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_sort_method(sim::Sort_Method::INCREMENTAL); } },
+			{ "separate prediction", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_kernel_fusion(sim::Kernel_Fusion::NONE); } },
+			{ "prediction fused with forces", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_kernel_fusion(sim::Kernel_Fusion::PREDICT_WITH_FORCES); } },
+			{ "prediction on the fly", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_kernel_fusion(sim::Kernel_Fusion::PREDICT_ON_THE_FLY); } },
+			{ "work-item per particle", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_work_distribution(sim::Work_Distribution::PER_PARTICLE); } },
+			{ "work-group per cell", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_work_distribution(sim::Work_Distribution::PER_CELL); } },
+			{ "full pair evaluation", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_pair_evaluation(sim::Pair_Evaluation::FULL); } },
+			{ "symmetric pair evaluation", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_pair_evaluation(sim::Pair_Evaluation::SYMMETRIC); } },
+			{ "generic programs", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_program_specialization(false); } },
+			{ "specialized programs", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_program_specialization(true); } },
+			{ "cold pressure start", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_pressure_warm_start(0.f); } },
+			{ "warm pressure start", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_pressure_warm_start(pressure_warm_start > 0.f ? pressure_warm_start : 0.5f); } },
+			{ "default work-group size", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_local_sizes({}); } },
+			{ "tuned work-group sizes", [&](sim::Fluid& fluid) { configure(fluid); } }
+		};
+		// -> the compressed storage replaces the packed layout
+		if(PARTICLE_LAYOUT == PARTICLE_LAYOUT_PACKED) {
+			variants.push_back({ "full precision storage", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_compressed_storage(false); } });
+			variants.push_back({ "compressed storage", [&](sim::Fluid& fluid) { configure(fluid); fluid.set_compressed_storage(true); } });
+		}
+
+		for(auto& variant : variants) {
+			std::cout << "[" << variant.first << "]" << std::endl;
+			print_result(run_simulation(cl_ctx, device, cl_queue, scene_name, simulation_duration, batch_size, variant.second));
+		}
+	}
+	catch(cl::Error& e) {
+		std::cout << e.what() << ": " << e.err() << std::endl;
+		return -1;
+	}
+	catch(std::exception& e) {
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
@@ -1,5 +1,6 @@
 #include "scenes.h"
 #include "sim/Fluid.h"
+#include "sim/program_cache.h"
 #include "vis/Fluid_Buffers.h"
 #include "vis/fluid_rendering.h"
 #include "vis/shader_cache.h"
@@ -17,6 +18,7 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <chrono>
 #include <iostream>
 
 int main(int argc, char** argv) {
@@ -87,6 +89,7 @@ int main(int argc, char** argv) {
 	try {
 		/////////////////
 		// OpenCL init //
+		auto context_start = std::chrono::high_resolution_clock::now();
 		cl::Device device;
 		std::vector<cl::Platform> platforms;
 		cl::Platform::get(&platforms);
@@ -127,6 +130,7 @@ int main(int argc, char** argv) {
 		}
 
 		cl::CommandQueue cl_queue = cl::CommandQueue(cl_ctx, device, CL_QUEUE_PROFILING_ENABLE);
+		std::cout << "Context creation: " << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - context_start).count() << "ms" << std::endl;
 
 		////////////////
 		// Simulation //
@@ -140,9 +144,27 @@ int main(int argc, char** argv) {
 		gl::Buffer boundary_cubes;
 		float boundary_cube_size = 0.f;
 
+		auto setup_start = std::chrono::high_resolution_clock::now();
 		vis::Fluid_Buffers fluid_buffers;
 		sim::Fluid fluid(cl_ctx, device, cl_queue);
-		scene::load(scene_name, fluid_buffers, fluid, boundary_cubes, boundary_cube_size, cam_distance);
+		// -> loads the scene and reports the startup stages. the cl programs are compiled on worker threads meanwhile
+		// (see sim/program_cache.h), the gl programs on this thread
+		bool report_first_step = false;
+		auto load_scene = [&](std::chrono::high_resolution_clock::time_point setup_start) {
+			scene::load(scene_name, fluid_buffers, fluid, boundary_cubes, boundary_cube_size, cam_distance);
+			vis::load_renderer_programs();
+			auto compile_wait_start = std::chrono::high_resolution_clock::now();
+			fluid.prepare();
+			cl_queue.finish();
+			auto compile_wait_end = std::chrono::high_resolution_clock::now();
+			const auto statistics = sim::get_program_cache_statistics();
+			std::cout << "Startup: scene generation " << std::chrono::duration<float, std::milli>(compile_wait_start - setup_start).count() << "ms, "
+				<< "waiting for the programs " << std::chrono::duration<float, std::milli>(compile_wait_end - compile_wait_start).count() << "ms "
+				<< "(compiled / loaded from the cache: " << statistics.compiled_programs << " / " << statistics.loaded_programs << ")" << std::endl;
+			sim::reset_program_cache_statistics();
+			report_first_step = true;
+		};
+		load_scene(setup_start);
 
 		///////////////
 		// Main loop //
@@ -158,9 +180,10 @@ int main(int argc, char** argv) {
 			glfwPollEvents();
 
 			if(glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+				auto reset_start = std::chrono::high_resolution_clock::now();
 				fluid_buffers = vis::Fluid_Buffers();
 				fluid = sim::Fluid(cl_ctx, device, cl_queue);
-				scene::load(scene_name, fluid_buffers, fluid, boundary_cubes, boundary_cube_size, cam_distance);
+				load_scene(reset_start);
 
 				simulation_time = 0.f;
 				record_frame_counter = 0;
@@ -184,18 +207,29 @@ int main(int argc, char** argv) {
 				fluid.fluid_positions,
 				fluid.fluid_normals,
 				fluid.fluid_densities,
-				fluid.fluid_velocities
+				fluid.fluid_velocities,
+				fluid.fluid_positions_back,
+				fluid.fluid_velocities_back
 			};
 
 			glFinish();
 			cl_queue.enqueueAcquireGLObjects(&gl_buffers);
-			do {
-				fluid.update();
-				simulation_time += fluid.get_params().delta_t;
-			} while(recording && (simulation_time - last_recorded_frame_time) <= recording_interval);
+			// -> all steps until the next recorded frame are enqueued at once
+			unsigned int step_count = 1;
+			const float remaining_time = recording_interval - (simulation_time - last_recorded_frame_time);
+			if(recording && remaining_time >= 0.f)
+				step_count = (unsigned int)(remaining_time / fluid.get_params().delta_t) + 1;
+
+			auto step_start = std::chrono::high_resolution_clock::now();
+			fluid.advance(step_count);
+			simulation_time += step_count * fluid.get_params().delta_t;
 
 			cl_queue.enqueueReleaseGLObjects(&gl_buffers);
 			cl_queue.finish();
+			if(report_first_step) {
+				std::cout << "-> First frame (" << step_count << " steps): " << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - step_start).count() << "ms" << std::endl;
+				report_first_step = false;
+			}
 
 			// rendering
 			vis::render_fluid_simple(trans, fluid, fluid_buffers);
@@ -0,0 +1,268 @@
+#include "scenes_host.h"
+
+#include <utils/file_io.h>
+
+#include <cstdint>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+
+namespace scene {
+	// https://voxel.codeplex.com/wikipage?title=XRAW%20Format&referringTitle=Update
+	namespace xraw {
+		enum class Voxel_Type {
+			BOUNDARY_VISIBLE,
+			BOUNDARY_INVISIBLE,
+			BLOCKER,
+			FLUID,
+			EMPTY
+		};
+
+#pragma pack(push, 1)
+		struct Header {
+			std::uint8_t magic_number[4];
+			std::uint8_t channdel_data_type;
+			std::uint8_t channel_count;
+			std::uint8_t bits_per_channel;
+			std::uint8_t bits_per_index;
+			std::uint32_t vol_size[3];
+			std::uint32_t palette_colors;
+		};
+#pragma pack(pop)
+
+		class Data {
+		public:
+			Data(const std::string& path) {
+				raw = utils::read_file(path);
+				if(raw.empty())
+					throw std::runtime_error("File not found: " + path);
+			}
+
+			const Header* header() const {
+				return reinterpret_cast<const Header*>(raw.data());
+			}
+
+			Voxel_Type voxel_type(std::uint32_t x, std::uint32_t y, std::uint32_t z) const {
+				switch(voxel_value(x, y, z)) {
+				case 1:
+					return Voxel_Type::BOUNDARY_VISIBLE;
+				case 2:
+					return Voxel_Type::BOUNDARY_INVISIBLE;
+				case 3:
+					return Voxel_Type::BLOCKER;
+				case 4:
+					return Voxel_Type::FLUID;
+				default:
+					return Voxel_Type::EMPTY;
+				}
+			}
+
+		private:
+			std::uint8_t voxel_value(std::uint32_t x, std::uint32_t y, std::uint32_t z) const {
+				auto size = header()->vol_size;
+				if(x >= size[0] || y >= size[1] || z >= size[2])
+					return 0;
+
+				auto idx = x + y * size[0] + z * size[0] * size[1];
+				auto base_ptr = reinterpret_cast<const std::uint8_t*>(raw.data() + sizeof(Header));
+				return base_ptr[idx];
+			}
+
+			std::string raw;
+		};
+	}
+
+	void load_xraw_host(const std::string& path, std::uint32_t particles_per_dimension, float scaling, std::vector<float>& fluid_positions, std::vector<float>& boundary_positions, std::vector<float>& boundary_cubes) {
+		xraw::Data data(path);
+		
+		float particle_scaling = scaling / particles_per_dimension;
+		auto size = data.header()->vol_size;
+
+		float position_offset[] = {
+			-0.5f * scaling * size[0],
+			-0.5f * scaling * size[2],
+			-0.5f * scaling * size[1]
+		};
+
+		auto add_cube = [&](std::int32_t bb_lower[], std::int32_t bb_upper[], std::vector<float>& positions) {
+			for(std::int32_t z = bb_lower[2]; z <= bb_upper[2]; z++) {
+				for(std::int32_t y = bb_lower[1]; y <= bb_upper[1]; y++) {
+					for(std::int32_t x = bb_lower[0]; x <= bb_upper[0]; x++) {
+						positions.push_back(x * particle_scaling + position_offset[0]);
+						positions.push_back(z * particle_scaling + position_offset[1]);
+						positions.push_back(y * particle_scaling + position_offset[2]);
+					}
+				}
+			}
+		};
+
+		for(std::uint32_t z = 0; z < size[2]; z++) {
+			for(std::uint32_t y = 0; y < size[1]; y++) {
+				for(std::uint32_t x = 0; x < size[0]; x++) {
+					auto type = data.voxel_type(x, y, z);
+
+					if(type == xraw::Voxel_Type::BOUNDARY_VISIBLE) {
+						boundary_cubes.push_back(x * scaling + position_offset[0]);
+						boundary_cubes.push_back(z * scaling + position_offset[1]);
+						boundary_cubes.push_back(y * scaling + position_offset[2]);
+					}
+
+					std::int32_t bb_lower[] = { 
+						x * particles_per_dimension, 
+						y * particles_per_dimension, 
+						z * particles_per_dimension 
+					};
+					std::int32_t bb_upper[] = { 
+						bb_lower[0] + particles_per_dimension - 1,
+						bb_lower[1] + particles_per_dimension - 1, 
+						bb_lower[2] + particles_per_dimension - 1 
+					};
+
+					if(data.voxel_type(x + 1, y, z) == xraw::Voxel_Type::BLOCKER)
+						bb_upper[0] = x * particles_per_dimension + 2;
+					if(data.voxel_type(x - 1, y, z) == xraw::Voxel_Type::BLOCKER)
+						bb_lower[0] = (x + 1) * particles_per_dimension - 3;
+
+					if(data.voxel_type(x, y + 1, z) == xraw::Voxel_Type::BLOCKER)
+						bb_upper[1] = y * particles_per_dimension + 2;
+					if(data.voxel_type(x, y - 1, z) == xraw::Voxel_Type::BLOCKER)
+						bb_lower[1] = (y + 1) * particles_per_dimension - 3;
+
+					if(data.voxel_type(x, y, z + 1) == xraw::Voxel_Type::BLOCKER)
+						bb_upper[2] = z * particles_per_dimension + 2;
+					if(data.voxel_type(x, y, z - 1) == xraw::Voxel_Type::BLOCKER)
+						bb_lower[2] = (z + 1) * particles_per_dimension - 3;
+
+					switch(type) {
+					case xraw::Voxel_Type::BOUNDARY_INVISIBLE:
+					case xraw::Voxel_Type::BOUNDARY_VISIBLE:
+						add_cube(bb_lower, bb_upper, boundary_positions);
+						break;
+					case xraw::Voxel_Type::FLUID:
+						add_cube(bb_lower, bb_upper, fluid_positions);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	void load_host(const std::string& name, sim::Fluid& fluid, Host_Data& out_data) {
+		// set default values
+		fluid.set_delta_t(0.002f);
+		fluid.set_rest_density(999.972f);
+		fluid.set_viscosity(0.00008f);
+		fluid.set_surface_tension(1.0f);
+		fluid.set_gravity(-9.81f);
+		fluid.set_density_variation_threshold(0.01f);
+		fluid.clear_particle_flow();
+		fluid.set_fluid_capacity(0);
+		float scaling = 0.7f;
+		out_data.cam_distance = 9.f;
+
+		// custom scene settings
+		std::string scene_file = name;
+		std::uint32_t particles_per_dimension = 3;
+		if(name == "simple_drop") {
+			particles_per_dimension = 30;
+			fluid.set_gravity(0.f);
+			out_data.cam_distance = 2.f;
+		}
+		if(name == "cube_splash") {
+			particles_per_dimension = 19;
+		}
+		else if(name == "dambreak") {
+			particles_per_dimension = 18;
+		}
+		else if(name == "dambreak_flow") {
+			// -> dambreak with an inflow and a drain (particle flow)
+			scene_file = "dambreak";
+			particles_per_dimension = 18;
+		}
+
+		// -> the generic programs don't depend on the scene, they are compiled while the particles are generated
+		if(!fluid.is_program_specialized())
+			fluid.start_program_builds();
+
+		// generate particles
+		out_data.fluid_positions.clear();
+		out_data.boundary_positions.clear();
+		out_data.boundary_cubes.clear();
+		load_xraw_host("data/scenes/" + scene_file + ".xraw", particles_per_dimension, scaling, out_data.fluid_positions, out_data.boundary_positions, out_data.boundary_cubes);
+		out_data.boundary_cube_size = scaling / particles_per_dimension;
+
+		fluid.set_particle_radius(0.5f * scaling / particles_per_dimension);
+		fluid.set_fluid_count((unsigned int) out_data.fluid_positions.size() / 3);
+		fluid.set_boundary_count((unsigned int) out_data.boundary_positions.size() / 3);
+
+		// -> the inflow enters above the empty side of the basin, the drain covers the floor below the initial fluid.
+		// the particles leaving the domain are removed, the capacity is reserved for twice the initial particles
+		if(name == "dambreak_flow") {
+			fluid.add_emitter({ { -3.4f, 1.0f, -0.6f }, { -3.1f, 1.6f, 0.6f }, { 2.f, 0.f, 0.f } });
+			fluid.add_sink({ { 2.8f, -0.7f, -1.4f }, { 3.5f, -0.4f, 1.4f } });
+			fluid.set_domain_culling(true);
+			fluid.set_fluid_capacity(2 * fluid.get_params().fluid_count);
+		}
+
+		// domain (bounding box of all particles)
+		std::array<float, 3> lower, upper;
+		lower.fill(std::numeric_limits<float>::max());
+		upper.fill(std::numeric_limits<float>::lowest());
+		for(auto positions : { &out_data.fluid_positions, &out_data.boundary_positions }) {
+			for(std::size_t i = 0; i < positions->size(); i++) {
+				lower[i % 3] = std::min(lower[i % 3], (*positions)[i]);
+				upper[i % 3] = std::max(upper[i % 3], (*positions)[i]);
+			}
+		}
+		if(!out_data.fluid_positions.empty() || !out_data.boundary_positions.empty())
+			fluid.set_domain(lower, upper);
+
+		// -> the specialized programs are compiled while the buffers are created (no-op for the generic programs)
+		fluid.start_program_builds();
+	}
+
+	void create_unshared_buffers(sim::Fluid& fluid, const Host_Data& data) {
+		if(data.boundary_positions.empty()) {
+			fluid.boundary_positions = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, 1);
+			fluid.boundary_pressures = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, 1);
+		}
+		else {
+			auto boundary_positions = fluid.to_particle_layout(data.boundary_positions, true);
+			fluid.boundary_positions = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, boundary_positions.size(), boundary_positions.data());
+			fluid.boundary_pressures = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid.get_params().boundary_count * sizeof(float));
+		}
+
+		// -> the fluid buffers are sized by the capacity (particle flow)
+		const auto fluid_capacity = fluid.get_params().fluid_capacity;
+		fluid.fluid_predicted_positions = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+		fluid.fluid_other_forces = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+		fluid.fluid_pressures = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * sizeof(float));
+		fluid.fluid_pressure_forces = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+	}
+
+	void load_headless(const std::string& name, sim::Fluid& fluid) {
+		Host_Data data;
+		load_host(name, fluid, data);
+		create_unshared_buffers(fluid, data);
+
+		// buffers which are shared with gl in the interactive version
+		const auto fluid_capacity = fluid.get_params().fluid_capacity;
+		auto fluid_positions = fluid.to_particle_layout(data.fluid_positions, true, fluid_capacity);
+		fluid.fluid_positions = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, fluid_positions.size(), fluid_positions.data());
+		fluid.fluid_normals = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+		fluid.fluid_densities = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * sizeof(float));
+		fluid.fluid_velocities = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+		fluid.fluid_positions_back = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+		fluid.fluid_velocities_back = cl::Buffer(fluid.ctx, CL_MEM_READ_WRITE, fluid_capacity * fluid.get_particle_vec_size());
+		print_info(fluid);
+	}
+
+	void print_info(const sim::Fluid& fluid) {
+		std::cout << "Scene loaded!" << std::endl;
+		std::cout << "-> Fluid-Particles: " << fluid.get_params().fluid_count << std::endl;
+		std::cout << "-> Boundary-Particles: " << fluid.get_params().boundary_count << std::endl;
+	}
+}
\ No newline at end of file
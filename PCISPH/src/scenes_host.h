@@ -0,0 +1,29 @@
+#pragma once
+
+#include "sim/Fluid.h"
+
+#include <string>
+#include <vector>
+
+namespace scene {
+	// scene data generated on the host (no gl required), the positions are packed float3 values
+	// (see sim::Fluid::to_particle_layout for the device layout)
+	struct Host_Data {
+		std::vector<float> fluid_positions;
+		std::vector<float> boundary_positions;
+		std::vector<float> boundary_cubes;
+		float boundary_cube_size;
+		float cam_distance;
+	};
+
+	// sets the simulation parameters of the scene and generates the particle positions
+	void load_host(const std::string& name, sim::Fluid& fluid, Host_Data& out_data);
+
+	// creates all cl buffers which are never shared with gl
+	void create_unshared_buffers(sim::Fluid& fluid, const Host_Data& data);
+
+	// loads a scene with plain cl buffers only
+	void load_headless(const std::string& name, sim::Fluid& fluid);
+
+	void print_info(const sim::Fluid& fluid);
+}
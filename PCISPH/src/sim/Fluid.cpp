@@ -1,6 +1,6 @@
 #include "Fluid.h"
+#include "program_cache.h"
 
-#include <utils/file_io.h>
 #include <utils/constants.h>
 
 #pragma warning(push, 0) 
@@ -10,8 +10,15 @@
 #include <vector>
 #include <limits>
 #include <cstdint>
+#include <cstddef>
 #include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <future>
 
 namespace sim {
 	cl::NDRange make_NDRange(std::uint32_t actual, std::uint32_t local_size) {
@@ -24,6 +31,192 @@ namespace sim {
 		return result;
 	}
 
+	unsigned int sort_bit_count(unsigned int elements) {
+		unsigned int max_value = 0;
+		for(int i = 0; i < 32; i++) {
+			max_value = (max_value << 1) | 1;
+			if(max_value >= elements - 1)
+				return i + 1;
+		}
+		throw std::runtime_error("sort_bit_count failed");
+	}
+
+	// the clogs primitives compile their programs on construction. they are created once per context and device on a worker thread
+	// (overlapping with the scene setup) and shared by all fluids (the fluids of a process never sort concurrently)
+	Fluid::Pending_Sort_Primitives get_shared_sort_primitives(cl::Context ctx, cl::Device device) {
+		static std::map<std::pair<cl_context, cl_device_id>, Fluid::Pending_Sort_Primitives> instances;
+		auto& instance = instances[std::make_pair(ctx(), device())];
+		if(!instance.valid()) {
+			instance = std::async(std::launch::async, [ctx, device]() {
+				clogs::RadixsortProblem sort_problem;
+				sort_problem.setKeyType(clogs::TYPE_UINT);
+				sort_problem.setValueType(clogs::TYPE_UINT);
+				auto radixsort = std::make_shared<clogs::Radixsort>(ctx, device, sort_problem);
+				auto scan = std::make_shared<clogs::Scan>(ctx, device, clogs::TYPE_UINT);
+				return std::make_pair(radixsort, scan);
+			}).share();
+		}
+		return instance;
+	}
+
+	// same as get_morton_code (grid_utils.cl)
+	std::uint32_t morton_code(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+		auto expand_bits = [](std::uint32_t v) {
+			v &= 0x3FF;
+			v = (v | (v << 16)) & 0x030000FF;
+			v = (v | (v << 8)) & 0x0300F00F;
+			v = (v | (v << 4)) & 0x030C30C3;
+			v = (v | (v << 2)) & 0x09249249;
+			return v;
+		};
+		return expand_bits(x) | (expand_bits(y) << 1) | (expand_bits(z) << 2);
+	}
+
+	// work-group size of the kernels without a tuned size (see local_size_tuning.h)
+	const std::uint32_t local_group_size = 64;
+	// the recorded launches are collected in between to limit the pending events
+	const std::size_t max_profiled_launches = 4096;
+
+	// work distribution of the two pass max/sum reduction
+	const std::uint32_t reduce_group_count = 64;
+	const std::uint32_t reduce_local_size = 64;
+
+	// work-group per cell: work-groups per compute unit, minimal local size (the 27 neighbor cell ranges are loaded 
+	// by one work-item each) and uints of the neighbor cell table (start and prefix sum per cell + neighbor count)
+	const std::uint32_t tile_groups_per_compute_unit = 16;
+	const std::uint32_t min_tile_local_size = 32;
+	const std::uint32_t tile_cells_size = 2 * 3 * 3 * 3 + 1;
+
+	// neighbor lists: entries per lattice neighbor (compression, denser boundary sampling), lists are padded to a multiple of 16 uints
+	const float neighbor_list_margin = 1.5f;
+	const std::uint32_t neighbor_list_alignment = 16;
+	// uints per fluid particle ((start, end) of the 27 neighbor cells)
+	const std::uint32_t cell_ranges_size = 2 * 3 * 3 * 3;
+
+	// PCISPH iteration limits
+	const unsigned int min_iterations = 2;
+	const unsigned int max_iterations = 7;
+
+	// float3 attributes are particle vectors
+	bool is_particle_vec(const Particle_Attribute& attribute) {
+		return attribute.type == Attribute_Type::FLOAT && attribute.width == 3;
+	}
+
+	// bytes per particle
+	std::size_t attribute_size(const Particle_Attribute& attribute, std::size_t particle_vec_size) {
+		return is_particle_vec(attribute) ? particle_vec_size : attribute.width * sizeof(cl_uint);
+	}
+
+	std::string attribute_type_name(Attribute_Type type) {
+		switch(type) {
+		case Attribute_Type::FLOAT:
+			return "float";
+		case Attribute_Type::INT:
+			return "int";
+		default:
+			return "uint";
+		}
+	}
+
+	// one gather (sorting) and one scatter (counting sort) kernel which reorder all persistent attributes in a single pass.
+	// the fixed arguments are followed by (in, out) pairs of all attributes. removed particles (key bucket_count) are dropped
+	std::string generate_attribute_kernels(const std::vector<Particle_Attribute>& attributes) {
+		std::string attribute_params;
+		std::string attribute_copies;
+		for(const auto& attribute : attributes) {
+			const auto type = attribute_type_name(attribute.type);
+			const auto in = "in_" + attribute.name;
+			const auto out = "out_" + attribute.name;
+			const auto width = std::to_string(attribute.width);
+			attribute_params += ", __global " + type + "* " + in + ", __global " + type + "* " + out;
+
+			if(is_particle_vec(attribute)) {
+				attribute_copies += "\tCOPY_PARTICLE_VEC(src_loc, " + in + ", dst_loc, " + out + ", params->fluid_capacity);\n";
+				continue;
+			}
+
+			switch(attribute.width) {
+			case 1:
+				attribute_copies += "\t" + out + "[dst_loc] = " + in + "[src_loc];\n";
+				break;
+			case 2: case 4: case 8: case 16:
+				attribute_copies += "\tvstore" + width + "(vload" + width + "(src_loc, " + in + "), dst_loc, " + out + ");\n";
+				break;
+			default:
+				attribute_copies += "\tfor(uint i = 0; i < " + width + "; i++)\n"
+					"\t\t" + out + "[dst_loc * " + width + " + i] = " + in + "[src_loc * " + width + " + i];\n";
+			}
+		}
+
+		return
+			"#include <data/kernels/sort_utils.cl>\n"
+			"\n"
+			"__kernel void gather_fluid_attributes(__constant Simulation_Params* params, uint particle_count, __global uint* cell_offsets, __global uint* src_locations, __global uint* fluid_keys" + attribute_params + ") {\n"
+			"\tuint dst_loc = get_global_id(0);\n"
+			"\tif(dst_loc >= particle_count || fluid_keys[dst_loc] >= CONST_PARAM(params, bucket_count))\n"
+			"\t\treturn;\n"
+			"\tuint src_loc = src_locations[dst_loc];\n"
+			+ attribute_copies +
+			"\tinsert_cell_offset(particle_count, cell_offsets, fluid_keys, dst_loc);\n"
+			"}\n"
+			"\n"
+			"__kernel void scatter_fluid_attributes(__constant Simulation_Params* params, uint particle_count, __global uint* cell_starts, __global uint* fluid_keys, __global uint* fluid_cell_indices" + attribute_params + ") {\n"
+			"\tuint src_loc = get_global_id(0);\n"
+			"\tif(src_loc >= particle_count || fluid_keys[src_loc] >= CONST_PARAM(params, bucket_count))\n"
+			"\t\treturn;\n"
+			"\tuint dst_loc = cell_starts[fluid_keys[src_loc]] + fluid_cell_indices[src_loc];\n"
+			+ attribute_copies +
+			"}\n";
+	}
+
+	// IEEE 754 half precision (round to nearest even), used for the compressed storage
+	std::uint16_t float_to_half(float value) {
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		const std::uint32_t sign = (bits >> 16) & 0x8000;
+		const std::int32_t float_exponent = (bits >> 23) & 0xFF;
+		const std::int32_t exponent = float_exponent - 127 + 15;
+		std::uint32_t mantissa = bits & 0x7FFFFF;
+
+		// -> inf / nan, overflow, underflow
+		if(float_exponent == 0xFF)
+			return (std::uint16_t) (sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+		if(exponent >= 31)
+			return (std::uint16_t) (sign | 0x7C00);
+		if(exponent < -10)
+			return (std::uint16_t) sign;
+
+		// -> subnormal or normal half, the rounding carry may increase the exponent
+		std::uint32_t shift = 13;
+		std::uint32_t result = sign | ((std::uint32_t) exponent << 10);
+		if(exponent <= 0) {
+			mantissa |= 0x800000;
+			shift = 14 - exponent;
+			result = sign;
+		}
+		const std::uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const std::uint32_t halfway = 1u << (shift - 1);
+		result += mantissa >> shift;
+		if(remainder > halfway || (remainder == halfway && (result & 1)))
+			result++;
+		return (std::uint16_t) result;
+	}
+
+	float half_to_float(std::uint16_t value) {
+		const std::uint32_t sign = (std::uint32_t) (value & 0x8000) << 16;
+		const std::uint32_t exponent = (value >> 10) & 0x1F;
+		const std::uint32_t mantissa = value & 0x3FF;
+		if(exponent == 0) {
+			const float result = std::ldexp((float) mantissa, -24);
+			return sign != 0 ? -result : result;
+		}
+
+		const std::uint32_t bits = sign | (exponent == 31 ? 0x7F800000 : ((exponent - 15 + 127) << 23)) | (mantissa << 13);
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
 	float duration_in_ms(cl::Event& e) {
 		return (e.getProfilingInfo<CL_PROFILING_COMMAND_END>() - e.getProfilingInfo<CL_PROFILING_COMMAND_START>()) / 1000000.f;
 	}
@@ -33,24 +226,174 @@ namespace sim {
 		this->ctx = ctx;
 		this->device = device;
 		this->queue = queue;
-		params_changed = true;
+		params_changed = Param_Change::BUFFERS;
 		boundary_updated = true;
+		kernel_arguments_outdated = true;
+		neighbor_search = Neighbor_Search::GRID;
+		sort_method = Sort_Method::RADIX;
+		incremental_sort_threshold = 0.1f;
+		sorted_keys_valid = false;
+		particle_buffers_swapped = false;
+		attribute_kernels_outdated = true;
+		sort_statistics = Sort_Statistics{ 0, 0, 0 };
+		std::fill(std::begin(sort_state), std::end(sort_state), 0);
+		std::fill(std::begin(read_sort_counters), std::end(read_sort_counters), 0);
+		neighbor_list_skin = 0.2f;
+		grown_neighbor_list_size = 0;
+		params.neighbor_search = NEIGHBOR_SEARCH_GRID;
+		params.grid_type = GRID_TYPE_HASHED;
+		params.cell_ordering = CELL_ORDERING_LINEAR;
+		domain_lower = { 0.f, 0.f, 0.f };
+		domain_upper = { 0.f, 0.f, 0.f };
+		pipelined_convergence_check = false;
+		pressure_warm_start = 0.f;
+		warm_pressures_valid = false;
+		solver_statistics = Solver_Statistics{ 0, 0.f, 0.f, 0, 0, false };
+		params.kernel_fusion = KERNEL_FUSION_NONE;
+		compressed_storage = false;
+		work_distribution = Work_Distribution::PER_PARTICLE;
+		pair_evaluation = Pair_Evaluation::FULL;
+		program_specialization = true;
+		steered_params = false;
+		tile_local_size = 0;
+		tile_group_count = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * tile_groups_per_compute_unit;
+		local_sizes = load_local_sizes(device, local_size_database_path);
+		default_local_size = local_group_size;
+		kernel_profiling = false;
+		domain_culling = false;
+		capacity_growth = true;
+		initial_fluid_count = 0;
+		reserved_fluid_capacity = 0;
+		max_fluid_count = 0;
+		params.fluid_count = 0;
+		params.fluid_capacity = 0;
+		update_position_quantization();
+
+		// the programs are compiled by the first update (they depend on the scene)
+
+		reduce_partial_results = cl::Buffer(ctx, CL_MEM_READ_WRITE, reduce_group_count * 2 * sizeof(cl_float));
+		fluid_density_variation_result = cl::Buffer(ctx, CL_MEM_READ_WRITE, 2 * sizeof(cl_float));
+		solver_state_buffer = cl::Buffer(ctx, CL_MEM_READ_WRITE, 2 * sizeof(cl_uint));
+		step_iterations_buffer = cl::Buffer(ctx, CL_MEM_READ_WRITE, sizeof(cl_uint));
+		params_buffer = cl::Buffer(ctx, CL_MEM_READ_ONLY, sizeof(Simulation_Params));
+		fluid_count_buffer = cl::Buffer(ctx, CL_MEM_READ_WRITE, sizeof(cl_uint));
+		neighbor_list_required_size_buffer = cl::Buffer(ctx, CL_MEM_READ_WRITE, sizeof(cl_uint));
+		const cl_uint no_required_size = 0;
+		queue.enqueueWriteBuffer(neighbor_list_required_size_buffer, CL_TRUE, 0, sizeof(cl_uint), &no_required_size);
+		fluid_sort_state = cl::Buffer(ctx, CL_MEM_READ_WRITE, sizeof(sort_state));
+		queue.enqueueWriteBuffer(fluid_sort_state, CL_TRUE, 0, sizeof(sort_state), sort_state);
+
+		// initialize radixsort and scan (counting sort), they are available after the first prepare_update
+		pending_sort_primitives = get_shared_sort_primitives(ctx, device);
+	}
+
+	std::string Fluid::get_required_build_params() const {
+		std::ostringstream result;
+		result << "-I ./ -DOPENCL_COMPILING -DNEIGHBOR_LIST_SIZE=" << get_neighbor_list_size() << " -DPARTICLE_LAYOUT=" << PARTICLE_LAYOUT;
+		if(compressed_storage)
+			result << " -DCOMPRESSED_STORAGE";
+		if(!program_specialization)
+			return result.str();
+
+		// -> features of the scene (see grid_utils.cl), the physical features are kept once the constants are steered
+		result << " -DSPECIALIZED_PARAMS";
+		if(steered_params)
+			result << " -DSTEERED_PARAMS";
+		result << " -DFEATURE_BOUNDARY=" << (params.boundary_count > 0 ? 1 : 0);
+		result << " -DFEATURE_GRAVITY=" << (steered_params || params.gravity != 0.f ? 1 : 0);
+		result << " -DFEATURE_VISCOSITY=" << (steered_params || params.viscosity_constant != 0.f ? 1 : 0);
+		result << " -DFEATURE_SURFACE_TENSION=" << (steered_params || params.surface_tension_coefficient != 0.f ? 1 : 0);
 
-		// compile 
-		std::string build_params = "-I ./ -DOPENCL_COMPILING";
-		auto create_program = [&](const std::string& path) {
-			auto source = utils::read_file(path);
-			return cl::Program(ctx, { std::make_pair(source.c_str(), source.size()) });
+		// -> fixed parameters (exact as hexadecimal floats). the particle counts, delta_t and the deduced scaling factor
+		// change during a simulation and stay in the parameter buffer
+		auto add_uint = [&](const char* name, cl_uint value) {
+			result << " -DCONST_PARAM_" << name << "=" << value << "u";
+		};
+		auto add_float = [&](const char* name, cl_float value) {
+			result << " -DCONST_PARAM_" << name << "=" << std::hexfloat << value << std::defaultfloat << "f";
+		};
+		if(!steered_params) {
+			add_float("particle_mass", params.particle_mass);
+			add_float("rest_density", params.rest_density);
+			add_float("surface_tension_coefficient", params.surface_tension_coefficient);
+			add_float("viscosity_constant", params.viscosity_constant);
+			add_float("gravity", params.gravity);
+		}
+		add_float("kernel_radius", params.kernel_radius);
+		add_float("kernel_radius2", params.kernel_radius2);
+		add_float("cell_size", params.cell_size);
+		add_uint("bucket_count", params.bucket_count);
+		add_uint("grid_type", params.grid_type);
+		add_uint("cell_ordering", params.cell_ordering);
+		add_float("grid_origin_x", params.grid_origin_x);
+		add_float("grid_origin_y", params.grid_origin_y);
+		add_float("grid_origin_z", params.grid_origin_z);
+		add_uint("grid_resolution_x", params.grid_resolution_x);
+		add_uint("grid_resolution_y", params.grid_resolution_y);
+		add_uint("grid_resolution_z", params.grid_resolution_z);
+		add_uint("neighbor_search", params.neighbor_search);
+		add_uint("kernel_fusion", params.kernel_fusion);
+		add_float("poly6_normalization", params.poly6_normalization);
+		add_float("poly6_d1_normalization", params.poly6_d1_normalization);
+		add_float("viscosity_d2_normalization", params.viscosity_d2_normalization);
+		add_float("spiky_d1_normalization", params.spiky_d1_normalization);
+		add_float("surface_tension_term", params.surface_tension_term);
+		add_float("surface_tension_normalization", params.surface_tension_normalization);
+		return result.str();
+	}
+
+	void Fluid::start_program_builds() {
+		// -> the specialized build options contain deduced parameters
+		if(params_changed != Param_Change::NONE)
+			update_deduced_params();
+		const auto required_build_params = get_required_build_params();
+		if(pending_build_params == required_build_params)
+			return;
+
+		// -> programs are cached (see program_cache.h), switching back to an earlier setup does not compile again
+		pending_build_params = required_build_params;
+		auto start_build = [&](const std::string& path) {
+			return build_cached_program_async(ctx, device, load_kernel_source(path), pending_build_params);
+		};
+		pending_sort_utils_prog = start_build("data/kernels/sort_utils.cl");
+		pending_reduce_utils_prog = start_build("data/kernels/reduce_utils.cl");
+		pending_pcisph_prog = start_build("data/kernels/pcisph.cl");
+	}
+
+	bool Fluid::is_program_specialized() const {
+		return program_specialization;
+	}
+
+	void Fluid::build_programs() {
+		// -> the programs are compiled concurrently on worker threads (if not already started by start_program_builds)
+		start_program_builds();
+		auto create_program = [&](const std::shared_future<cl::Program>& pending, cl::Program& program) {
+			wait_for_program(pending, device, program);
 		};
 		
 		// -> sort utils
 		try {
-			sort_utils_prog = create_program("data/kernels/sort_utils.cl");
-			sort_utils_prog.build({ device }, build_params.c_str());
-			sort_utils_reset_cell_offsets = cl::Kernel(sort_utils_prog, "reset_cell_offsets");
-			sort_utils_initialize = cl::Kernel(sort_utils_prog, "initialize");
+			create_program(pending_sort_utils_prog, sort_utils_prog);
+			sort_utils_reset_boundary_cell_offsets = cl::Kernel(sort_utils_prog, "reset_cell_offsets");
+			sort_utils_reset_fluid_cell_offsets = cl::Kernel(sort_utils_prog, "reset_cell_offsets");
+			sort_utils_initialize_boundary = cl::Kernel(sort_utils_prog, "initialize");
+			sort_utils_initialize_fluid = cl::Kernel(sort_utils_prog, "initialize_fluid");
 			sort_utils_reorder_and_insert_boundary_offsets = cl::Kernel(sort_utils_prog, "reorder_and_insert_boundary_offsets");
-			sort_utils_reorder_and_insert_fluid_offsets = cl::Kernel(sort_utils_prog, "reorder_and_insert_fluid_offsets");
+			sort_utils_build_fluid_neighbor_lists = cl::Kernel(sort_utils_prog, "build_neighbor_lists");
+			sort_utils_build_boundary_neighbor_lists = cl::Kernel(sort_utils_prog, "build_neighbor_lists");
+			sort_utils_build_fluid_cell_ranges = cl::Kernel(sort_utils_prog, "build_cell_ranges");
+			sort_utils_build_boundary_cell_ranges = cl::Kernel(sort_utils_prog, "build_cell_ranges");
+			sort_utils_reset_fluid_cell_counts = cl::Kernel(sort_utils_prog, "reset_cell_counts");
+			sort_utils_count_fluid_particles_per_cell = cl::Kernel(sort_utils_prog, "count_particles_per_cell");
+			sort_utils_insert_counted_fluid_cell_offsets = cl::Kernel(sort_utils_prog, "insert_counted_cell_offsets");
+			sort_utils_flag_moved_particles = cl::Kernel(sort_utils_prog, "flag_moved_particles");
+			sort_utils_gather_moved_particles = cl::Kernel(sort_utils_prog, "gather_moved_particles");
+			sort_utils_merge_moved_particles = cl::Kernel(sort_utils_prog, "merge_moved_particles");
+			sort_utils_select_sort_path = cl::Kernel(sort_utils_prog, "select_sort_path");
+			sort_utils_reset_fallback_cell_counts = cl::Kernel(sort_utils_prog, "reset_fallback_cell_counts");
+			sort_utils_flag_occupied_cells = cl::Kernel(sort_utils_prog, "flag_occupied_cells");
+			sort_utils_compact_occupied_cells = cl::Kernel(sort_utils_prog, "compact_occupied_cells");
+			sort_utils_update_sorted_fluid_count = cl::Kernel(sort_utils_prog, "update_sorted_fluid_count");
 		}
 		catch(cl::Error&) {
 			std::cout << "sort_utils_prog program failed to build" << std::endl;
@@ -59,19 +402,40 @@ namespace sim {
 			std::rethrow_exception(std::current_exception());
 		}
 
+		// -> reduce utils
+		try {
+			create_program(pending_reduce_utils_prog, reduce_utils_prog);
+			reduce_utils_max_and_sum = cl::Kernel(reduce_utils_prog, "reduce_max_and_sum");
+			reduce_utils_max_and_sum_partials = cl::Kernel(reduce_utils_prog, "reduce_max_and_sum_partials");
+		}
+		catch(cl::Error&) {
+			std::cout << "reduce_utils_prog program failed to build" << std::endl;
+			std::cout << reduce_utils_prog.getBuildInfo<CL_PROGRAM_BUILD_LOG>(this->device) << std::endl;
+			std::getchar();
+			std::rethrow_exception(std::current_exception());
+		}
 		// -> pcisph
 		try {
-			pcisph_prog = create_program("data/kernels/pcisph.cl");
-			pcisph_prog.build({ device }, build_params.c_str());
+			create_program(pending_pcisph_prog, pcisph_prog);
 
 			pcisph_update_density = cl::Kernel(pcisph_prog, "update_density");
 			pcisph_update_normal = cl::Kernel(pcisph_prog, "update_normal");
 			pcisph_boundary_pressure_initialization = cl::Kernel(pcisph_prog, "boundary_pressure_initialization");
 			pcisph_force_initialization = cl::Kernel(pcisph_prog, "force_initialization");
+			pcisph_predict_positions = cl::Kernel(pcisph_prog, "update_position_and_velocity");
 			pcisph_update_position_and_velocity = cl::Kernel(pcisph_prog, "update_position_and_velocity");
 			pcisph_initialize_boundary_boundary_pred_densities = cl::Kernel(pcisph_prog, "initialize_boundary_boundary_pred_densities");
-			pcisph_update_pressure = cl::Kernel(pcisph_prog, "update_pressure");
+			pcisph_update_boundary_pressure = cl::Kernel(pcisph_prog, "update_boundary_pressure");
+			pcisph_update_fluid_pressure = cl::Kernel(pcisph_prog, "update_fluid_pressure");
 			pcisph_update_pressure_force = cl::Kernel(pcisph_prog, "update_pressure_force");
+			pcisph_update_density_tiled = cl::Kernel(pcisph_prog, "update_density_tiled");
+			pcisph_update_fluid_pressure_tiled = cl::Kernel(pcisph_prog, "update_pressure_tiled");
+			pcisph_update_pressure_force_tiled = cl::Kernel(pcisph_prog, "update_pressure_force_tiled");
+			pcisph_accumulate_other_forces = cl::Kernel(pcisph_prog, "accumulate_other_forces");
+			pcisph_accumulate_pressure_forces = cl::Kernel(pcisph_prog, "accumulate_pressure_forces");
+			pcisph_reset_solver_state = cl::Kernel(pcisph_prog, "reset_solver_state");
+			pcisph_update_solver_state = cl::Kernel(pcisph_prog, "update_solver_state");
+			pcisph_emit_particles = cl::Kernel(pcisph_prog, "emit_particles");
 		}
 		catch(cl::Error&) {
 			std::cout << "PCISPH program failed to build" << std::endl;
@@ -80,301 +444,1532 @@ namespace sim {
 			std::rethrow_exception(std::current_exception());
 		}
 
-		// initialize radixsort
-		clogs::RadixsortProblem sort_problem;
-		sort_problem.setKeyType(clogs::TYPE_UINT);
-		sort_problem.setValueType(clogs::TYPE_UINT);
-		radixsort.reset(new clogs::Radixsort(ctx, device, sort_problem));
+		kernel_launch_configs.clear();
+
+		// -> local size of the tiled kernels, limited by the kernels and the local memory (one float4 per tile entry)
+		tile_local_size = local_group_size;
+		for(auto kernel : { &pcisph_update_density_tiled, &pcisph_update_fluid_pressure_tiled, &pcisph_update_pressure_force_tiled })
+			tile_local_size = std::min(tile_local_size, (std::uint32_t) kernel->getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		const auto local_mem_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+		while(tile_local_size >= min_tile_local_size && tile_local_size * sizeof(cl_float4) + tile_cells_size * sizeof(cl_uint) > local_mem_size)
+			tile_local_size /= 2;
+		// -> not supported, reported by the solver statistics
+		if(tile_local_size < min_tile_local_size)
+			tile_local_size = 0;
 	}
 
 	void Fluid::checkBuffersConsistent() const {
-		auto expected_fluid_count = params.fluid_count;
+		auto expected_fluid_count = params.fluid_capacity;
 
 		auto check = [&](std::size_t size, std::size_t multiplier, const std::string& name) {
 			if(size != expected_fluid_count * multiplier)
 				throw std::runtime_error("Inconsistent " + name + " (" + std::to_string(size) + ") for " + std::to_string(expected_fluid_count) + " particles");
 		};
 
-		check(fluid_positions.getInfo<CL_MEM_SIZE>(), 3 * sizeof(cl_float), "positions_size");
-		check(fluid_normals.getInfo<CL_MEM_SIZE>(), 3 * sizeof(cl_float), "normals_size");
-		check(fluid_predicted_positions.getInfo<CL_MEM_SIZE>(), 3 * sizeof(cl_float), "predicted_positions_size");
+		check(fluid_positions.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "positions_size");
+		check(fluid_normals.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "normals_size");
+		check(fluid_predicted_positions.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "predicted_positions_size");
 		check(fluid_densities.getInfo<CL_MEM_SIZE>(), sizeof(cl_float), "densities_size");
-		check(fluid_other_forces.getInfo<CL_MEM_SIZE>(), 3 * sizeof(cl_float), "other_forces_size");
-		check(fluid_velocities.getInfo<CL_MEM_SIZE>(), 3 * sizeof(cl_float), "velocities_size");
+		check(fluid_other_forces.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "other_forces_size");
+		check(fluid_velocities.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "velocities_size");
+		check(fluid_positions_back.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "positions_back_size");
+		check(fluid_velocities_back.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "velocities_back_size");
+		for(const auto& attribute : attributes)
+			check(attribute.front.getInfo<CL_MEM_SIZE>(), attribute_size(attribute.attribute, get_particle_vec_size()), attribute.attribute.name + "_size");
 		check(fluid_pressures.getInfo<CL_MEM_SIZE>(), sizeof(cl_float), "pressures_size");
-		check(fluid_pressure_forces.getInfo<CL_MEM_SIZE>(), 3 * sizeof(cl_float), "pressure_forces_size");
+		check(fluid_pressure_forces.getInfo<CL_MEM_SIZE>(), get_particle_vec_size(), "pressure_forces_size");
 	}
 	
-	void Fluid::update() {
-		if(params_changed) {
-			update_deduced_attributes();
-			params_changed = false;
+	bool Fluid::prepare_update() {
+		if(params_changed != Param_Change::NONE) {
+			// -> a changed constant only updates the parameter buffer, the buffers and bound kernel arguments stay valid
+			if(params_changed == Param_Change::BUFFERS) {
+				update_deduced_attributes();
+				max_fluid_count = params.fluid_count;
+			}
+			else {
+				update_deduced_params();
+				if(params_changed == Param_Change::GRID)
+					allocate_grid_buffers();
+			}
+			queue.enqueueWriteBuffer(params_buffer, CL_TRUE, 0, sizeof(Simulation_Params), &params);
+			queue.enqueueWriteBuffer(fluid_count_buffer, CL_TRUE, 0, sizeof(cl_uint), &params.fluid_count);
+			if(params_changed != Param_Change::CONSTANTS)
+				kernel_arguments_outdated = true;
+			params_changed = Param_Change::NONE;
 		}
 
-		checkBuffersConsistent();
+		// -> settings which change the buffer contents (a switch of the programs alone keeps them)
+		const bool settings_changed = kernel_arguments_outdated || attribute_kernels_outdated;
+
+		// -> programs (rebuilt if the build options changed, e.g. by a specialized parameter)
+		auto required_build_params = get_required_build_params();
+		if(required_build_params != build_params) {
+			build_params = required_build_params;
+			build_programs();
+			attribute_kernels_outdated = true;
+			kernel_arguments_outdated = true;
+		}
+
+		// -> sort primitives (created on a worker thread)
+		if(!radixsort) {
+			auto sort_primitives = pending_sort_primitives.get();
+			radixsort = sort_primitives.first;
+			scan = sort_primitives.second;
+		}
+
+		// -> reorder kernels of the registered attributes
+		if(attribute_kernels_outdated) {
+			build_attribute_kernels();
+			attribute_kernels_outdated = false;
+			kernel_arguments_outdated = true;
+		}
+
+		// -> buffers of the current neighbor search, sort method and work distribution
+		if(kernel_arguments_outdated)
+			allocate_search_buffers();
+
+		// kernel arguments are only bound again if a buffer was (re)allocated or a setting changed
+		auto buffer_handles = get_buffer_handles();
+		if(kernel_arguments_outdated || buffer_handles != bound_buffer_handles) {
+			checkBuffersConsistent();
+			bind_kernel_arguments();
+			// -> the sorted keys and warm-start pressures survive a program switch which keeps the buffers
+			if(settings_changed || buffer_handles != bound_buffer_handles) {
+				sorted_keys_valid = false;
+				warm_pressures_valid = false;
+			}
+			bound_buffer_handles = buffer_handles;
+			kernel_arguments_outdated = false;
+		}
+		solver_statistics.cell_tiles_unsupported = work_distribution == Work_Distribution::PER_CELL && !uses_cell_tiles();
+		return params.fluid_count > 0 || !emitters.empty();
+	}
+
+	std::vector<cl_mem> Fluid::get_buffer_handles() const {
+		std::vector<cl_mem> handles = {
+			boundary_positions(), boundary_pressures(),
+			fluid_normals(), fluid_predicted_positions(), fluid_densities(),
+			fluid_other_forces(), fluid_pressure_forces(),
+			boundary_cell_offsets(), boundary_keys(), boundary_src_locations(), boundary_positions_tmp(), boundary_init_pred_densities(),
+			fluid_cell_offsets(), fluid_keys(), fluid_src_locations(), fluid_density_variations(), fluid_cell_starts(),
+			fluid_moved_flags(), fluid_mover_offsets(), fluid_stay_keys(), fluid_mover_keys(), fluid_mover_ids(),
+			fluid_occupied_cell_indices(), fluid_occupied_cells(), fluid_pair_forces(),
+			fluid_neighbor_cache(), boundary_neighbor_cache(),
+			fluid_sinks_buffer()
+		};
+
+		// -> the front and back buffers are listed independently of the swapping
+		auto add_pair = [&](const cl::Buffer& front, const cl::Buffer& back) {
+			handles.push_back(particle_buffers_swapped ? back() : front());
+			handles.push_back(particle_buffers_swapped ? front() : back());
+		};
+		add_pair(fluid_positions, fluid_positions_back);
+		add_pair(fluid_velocities, fluid_velocities_back);
+		if(pressure_warm_start > 0.f)
+			add_pair(fluid_pressures, fluid_pressures_back);
+		else
+			handles.push_back(fluid_pressures());
+		for(const auto& attribute : attributes)
+			add_pair(attribute.front, attribute.back);
+		return handles;
+	}
+
+	void Fluid::bind_kernel_arguments() {
+		/////////////////////////////
+		// sort boundary particles //
+		sort_utils_reset_boundary_cell_offsets.setArg(0, params_buffer);
+		sort_utils_reset_boundary_cell_offsets.setArg(1, boundary_cell_offsets);
+
+		sort_utils_initialize_boundary.setArg(0, params_buffer);
+		sort_utils_initialize_boundary.setArg(1, params.boundary_count);
+		sort_utils_initialize_boundary.setArg(2, boundary_keys);
+		sort_utils_initialize_boundary.setArg(3, boundary_positions);
+		sort_utils_initialize_boundary.setArg(4, boundary_src_locations);
+
+		sort_utils_reorder_and_insert_boundary_offsets.setArg(0, (cl_uint)params.boundary_count);
+		sort_utils_reorder_and_insert_boundary_offsets.setArg(1, boundary_cell_offsets);
+		sort_utils_reorder_and_insert_boundary_offsets.setArg(2, boundary_src_locations);
+		sort_utils_reorder_and_insert_boundary_offsets.setArg(3, boundary_keys);
+		sort_utils_reorder_and_insert_boundary_offsets.setArg(4, boundary_positions_tmp);
+		sort_utils_reorder_and_insert_boundary_offsets.setArg(5, boundary_positions);
+
+		pcisph_initialize_boundary_boundary_pred_densities.setArg(0, params_buffer);
+		pcisph_initialize_boundary_boundary_pred_densities.setArg(1, boundary_cell_offsets);
+		pcisph_initialize_boundary_boundary_pred_densities.setArg(2, boundary_positions);
+		pcisph_initialize_boundary_boundary_pred_densities.setArg(3, boundary_init_pred_densities);
+
+		//////////////////////////
+		// sort fluid particles //
+		sort_utils_reset_fluid_cell_offsets.setArg(0, params_buffer);
+		sort_utils_reset_fluid_cell_offsets.setArg(1, fluid_cell_offsets);
+
+		// -> the particle counts of the sort kernels are set per step (bound of the active count)
+		sort_utils_initialize_fluid.setArg(0, params_buffer);
+		sort_utils_initialize_fluid.setArg(2, fluid_keys);
+		sort_utils_initialize_fluid.setArg(4, fluid_src_locations);
+		sort_utils_initialize_fluid.setArg(5, fluid_sinks_buffer);
+		sort_utils_initialize_fluid.setArg(6, (cl_uint)sinks.size());
+		sort_utils_initialize_fluid.setArg(7, (cl_uint)domain_culling);
+
+		attribute_gather_fluid.setArg(0, params_buffer);
+		attribute_gather_fluid.setArg(2, fluid_cell_offsets);
+		attribute_gather_fluid.setArg(3, fluid_src_locations);
+		attribute_gather_fluid.setArg(4, fluid_keys);
+
+		sort_utils_update_sorted_fluid_count.setArg(0, params_buffer);
+		sort_utils_update_sorted_fluid_count.setArg(2, fluid_keys);
+		sort_utils_update_sorted_fluid_count.setArg(3, fluid_count_buffer);
+
+		// -> counting sort (the src locations buffer stores the index of a particle inside of its cell)
+		sort_utils_reset_fluid_cell_counts.setArg(0, params_buffer);
+		sort_utils_reset_fluid_cell_counts.setArg(1, fluid_cell_starts);
+
+		sort_utils_count_fluid_particles_per_cell.setArg(0, params_buffer);
+		sort_utils_count_fluid_particles_per_cell.setArg(3, fluid_cell_starts);
+		sort_utils_count_fluid_particles_per_cell.setArg(4, fluid_keys);
+		sort_utils_count_fluid_particles_per_cell.setArg(5, fluid_src_locations);
+		sort_utils_count_fluid_particles_per_cell.setArg(6, fluid_sinks_buffer);
+		sort_utils_count_fluid_particles_per_cell.setArg(7, (cl_uint)sinks.size());
+		sort_utils_count_fluid_particles_per_cell.setArg(8, (cl_uint)domain_culling);
+
+		sort_utils_insert_counted_fluid_cell_offsets.setArg(0, params_buffer);
+		sort_utils_insert_counted_fluid_cell_offsets.setArg(1, fluid_cell_starts);
+		sort_utils_insert_counted_fluid_cell_offsets.setArg(2, fluid_cell_offsets);
+
+		attribute_scatter_fluid.setArg(0, params_buffer);
+		attribute_scatter_fluid.setArg(2, fluid_cell_starts);
+		attribute_scatter_fluid.setArg(3, fluid_keys);
+		attribute_scatter_fluid.setArg(4, fluid_src_locations);
+
+		// -> incremental sort (not used with particle flow, the count is fixed)
+		sort_utils_flag_moved_particles.setArg(0, params_buffer);
+		sort_utils_flag_moved_particles.setArg(1, params.fluid_count);
+		sort_utils_flag_moved_particles.setArg(3, fluid_keys);
+		sort_utils_flag_moved_particles.setArg(4, fluid_moved_flags);
+
+		sort_utils_select_sort_path.setArg(0, params.fluid_count);
+		sort_utils_select_sort_path.setArg(2, fluid_mover_offsets);
+		sort_utils_select_sort_path.setArg(3, fluid_sort_state);
+
+		sort_utils_reset_fallback_cell_counts.setArg(0, params_buffer);
+		sort_utils_reset_fallback_cell_counts.setArg(1, fluid_sort_state);
+		sort_utils_reset_fallback_cell_counts.setArg(2, fluid_cell_starts);
+
+		sort_utils_gather_moved_particles.setArg(0, params_buffer);
+		sort_utils_gather_moved_particles.setArg(1, params.fluid_count);
+		sort_utils_gather_moved_particles.setArg(3, fluid_keys);
+		sort_utils_gather_moved_particles.setArg(4, fluid_moved_flags);
+		sort_utils_gather_moved_particles.setArg(5, fluid_mover_offsets);
+		sort_utils_gather_moved_particles.setArg(6, fluid_stay_keys);
+		sort_utils_gather_moved_particles.setArg(7, fluid_mover_keys);
+		sort_utils_gather_moved_particles.setArg(8, fluid_mover_ids);
+		sort_utils_gather_moved_particles.setArg(9, fluid_sort_state);
+		sort_utils_gather_moved_particles.setArg(10, fluid_cell_starts);
+
+		sort_utils_merge_moved_particles.setArg(0, params.fluid_count);
+		sort_utils_merge_moved_particles.setArg(1, fluid_moved_flags);
+		sort_utils_merge_moved_particles.setArg(2, fluid_mover_offsets);
+		sort_utils_merge_moved_particles.setArg(3, fluid_stay_keys);
+		sort_utils_merge_moved_particles.setArg(4, fluid_mover_keys);
+		sort_utils_merge_moved_particles.setArg(5, fluid_mover_ids);
+		sort_utils_merge_moved_particles.setArg(6, fluid_keys);
+		sort_utils_merge_moved_particles.setArg(7, fluid_src_locations);
+		sort_utils_merge_moved_particles.setArg(8, fluid_sort_state);
+		sort_utils_merge_moved_particles.setArg(9, fluid_cell_starts);
+
+		// -> occupied cells
+		sort_utils_flag_occupied_cells.setArg(0, params_buffer);
+		sort_utils_flag_occupied_cells.setArg(2, fluid_cell_offsets);
+		sort_utils_flag_occupied_cells.setArg(3, fluid_occupied_cell_indices);
+
+		sort_utils_compact_occupied_cells.setArg(0, params_buffer);
+		sort_utils_compact_occupied_cells.setArg(1, fluid_occupied_cell_indices);
+		sort_utils_compact_occupied_cells.setArg(2, fluid_occupied_cells);
+
+		// -> neighbor lists (kernel radius + skin to cover the predicted positions)
+		const float search_radius2 = std::pow(params.kernel_radius * (1.f + neighbor_list_skin), 2.f);
+		sort_utils_build_fluid_neighbor_lists.setArg(0, params_buffer);
+		sort_utils_build_fluid_neighbor_lists.setArg(1, search_radius2);
+		sort_utils_build_fluid_neighbor_lists.setArg(3, fluid_cell_offsets);
+		sort_utils_build_fluid_neighbor_lists.setArg(5, fluid_neighbor_cache);
+		sort_utils_build_fluid_neighbor_lists.setArg(6, (cl_uint)params.fluid_capacity);
+		sort_utils_build_fluid_neighbor_lists.setArg(7, neighbor_list_required_size_buffer);
+
+		sort_utils_build_boundary_neighbor_lists.setArg(0, params_buffer);
+		sort_utils_build_boundary_neighbor_lists.setArg(1, search_radius2);
+		sort_utils_build_boundary_neighbor_lists.setArg(3, boundary_cell_offsets);
+		sort_utils_build_boundary_neighbor_lists.setArg(4, boundary_positions);
+		sort_utils_build_boundary_neighbor_lists.setArg(5, boundary_neighbor_cache);
+		sort_utils_build_boundary_neighbor_lists.setArg(6, (cl_uint)params.boundary_count);
+		sort_utils_build_boundary_neighbor_lists.setArg(7, neighbor_list_required_size_buffer);
+
+		// -> cell ranges
+		sort_utils_build_fluid_cell_ranges.setArg(0, params_buffer);
+		sort_utils_build_fluid_cell_ranges.setArg(2, fluid_cell_offsets);
+		sort_utils_build_fluid_cell_ranges.setArg(3, fluid_neighbor_cache);
+
+		sort_utils_build_boundary_cell_ranges.setArg(0, params_buffer);
+		sort_utils_build_boundary_cell_ranges.setArg(2, boundary_cell_offsets);
+		sort_utils_build_boundary_cell_ranges.setArg(3, boundary_neighbor_cache);
+
+		//////////////////////
+		// force initialization //
+		pcisph_update_density.setArg(0, params_buffer);
+		pcisph_update_density.setArg(1, boundary_cell_offsets);
+		pcisph_update_density.setArg(2, boundary_neighbor_cache);
+		pcisph_update_density.setArg(3, boundary_positions);
+		pcisph_update_density.setArg(4, fluid_cell_offsets);
+		pcisph_update_density.setArg(5, fluid_neighbor_cache);
+		pcisph_update_density.setArg(7, fluid_densities);
+
+		if(uses_cell_tiles()) {
+			pcisph_update_density_tiled.setArg(0, params_buffer);
+			pcisph_update_density_tiled.setArg(1, boundary_cell_offsets);
+			pcisph_update_density_tiled.setArg(2, boundary_positions);
+			pcisph_update_density_tiled.setArg(3, fluid_cell_offsets);
+			pcisph_update_density_tiled.setArg(5, fluid_densities);
+			pcisph_update_density_tiled.setArg(6, fluid_occupied_cells);
+			pcisph_update_density_tiled.setArg(7, cl::__local(tile_local_size * sizeof(cl_float4)));
+			pcisph_update_density_tiled.setArg(8, cl::__local(tile_cells_size * sizeof(cl_uint)));
+		}
+
+		pcisph_update_normal.setArg(0, params_buffer);
+		pcisph_update_normal.setArg(1, fluid_cell_offsets);
+		pcisph_update_normal.setArg(2, fluid_neighbor_cache);
+		pcisph_update_normal.setArg(4, fluid_densities);
+		pcisph_update_normal.setArg(5, fluid_normals);
+
+		pcisph_boundary_pressure_initialization.setArg(0, params_buffer);
+		pcisph_boundary_pressure_initialization.setArg(1, boundary_pressures);
+
+		pcisph_force_initialization.setArg(0, params_buffer);
+		pcisph_force_initialization.setArg(1, fluid_cell_offsets);
+		pcisph_force_initialization.setArg(2, fluid_neighbor_cache);
+		pcisph_force_initialization.setArg(4, fluid_normals);
+		pcisph_force_initialization.setArg(5, fluid_densities);
+		pcisph_force_initialization.setArg(7, fluid_other_forces);
+		pcisph_force_initialization.setArg(9, fluid_pressure_forces);
+		pcisph_force_initialization.setArg(10, fluid_predicted_positions);
+
+		// -> pair evaluation (the full evaluation only uses the accumulation kernels in measure_force_balance)
+		const bool symmetric = pair_evaluation == Pair_Evaluation::SYMMETRIC;
+		pcisph_force_initialization.setArg(11, symmetric ? fluid_pair_forces : cl::Buffer());
+
+		pcisph_accumulate_other_forces.setArg(0, params_buffer);
+		pcisph_accumulate_other_forces.setArg(1, (cl_uint)symmetric);
+		pcisph_accumulate_other_forces.setArg(2, fluid_cell_offsets);
+		pcisph_accumulate_other_forces.setArg(3, fluid_neighbor_cache);
+		pcisph_accumulate_other_forces.setArg(5, fluid_normals);
+		pcisph_accumulate_other_forces.setArg(6, fluid_densities);
+		pcisph_accumulate_other_forces.setArg(8, fluid_pair_forces);
+
+		pcisph_accumulate_pressure_forces.setArg(0, params_buffer);
+		pcisph_accumulate_pressure_forces.setArg(1, (cl_uint)symmetric);
+		pcisph_accumulate_pressure_forces.setArg(2, fluid_cell_offsets);
+		pcisph_accumulate_pressure_forces.setArg(3, fluid_neighbor_cache);
+		pcisph_accumulate_pressure_forces.setArg(5, fluid_densities);
+		pcisph_accumulate_pressure_forces.setArg(7, fluid_pair_forces);
+		pcisph_accumulate_pressure_forces.setArg(8, solver_state_buffer);
+
+		///////////////////////
+		// PCISPH iterations //
+		pcisph_predict_positions.setArg(0, params_buffer);
+		pcisph_predict_positions.setArg(3, fluid_other_forces);
+		pcisph_predict_positions.setArg(4, fluid_pressure_forces);
+		pcisph_predict_positions.setArg(5, fluid_predicted_positions);
+		pcisph_predict_positions.setArg(6, nullptr);
+		pcisph_predict_positions.setArg(7, solver_state_buffer);
+
+		// -> boundary particles always search the grid
+		pcisph_update_boundary_pressure.setArg(0, params_buffer);
+		pcisph_update_boundary_pressure.setArg(1, boundary_cell_offsets);
+		pcisph_update_boundary_pressure.setArg(2, nullptr);
+		pcisph_update_boundary_pressure.setArg(3, boundary_positions);
+		pcisph_update_boundary_pressure.setArg(4, boundary_init_pred_densities);
+		pcisph_update_boundary_pressure.setArg(5, fluid_cell_offsets);
+		pcisph_update_boundary_pressure.setArg(6, nullptr);
+		pcisph_update_boundary_pressure.setArg(8, fluid_predicted_positions);
+		pcisph_update_boundary_pressure.setArg(9, nullptr);
+		pcisph_update_boundary_pressure.setArg(10, boundary_pressures);
+		pcisph_update_boundary_pressure.setArg(11, solver_state_buffer);
+		pcisph_update_boundary_pressure.setArg(13, fluid_other_forces);
+		pcisph_update_boundary_pressure.setArg(14, fluid_pressure_forces);
+
+		pcisph_update_fluid_pressure.setArg(0, params_buffer);
+		pcisph_update_fluid_pressure.setArg(1, boundary_cell_offsets);
+		pcisph_update_fluid_pressure.setArg(2, boundary_neighbor_cache);
+		pcisph_update_fluid_pressure.setArg(3, boundary_positions);
+		pcisph_update_fluid_pressure.setArg(4, boundary_init_pred_densities);
+		pcisph_update_fluid_pressure.setArg(5, fluid_cell_offsets);
+		pcisph_update_fluid_pressure.setArg(6, fluid_neighbor_cache);
+		pcisph_update_fluid_pressure.setArg(8, fluid_predicted_positions);
+		pcisph_update_fluid_pressure.setArg(9, fluid_density_variations);
+		pcisph_update_fluid_pressure.setArg(11, solver_state_buffer);
+		pcisph_update_fluid_pressure.setArg(13, fluid_other_forces);
+		pcisph_update_fluid_pressure.setArg(14, fluid_pressure_forces);
+
+		pcisph_update_pressure_force.setArg(0, params_buffer);
+		pcisph_update_pressure_force.setArg(1, boundary_cell_offsets);
+		pcisph_update_pressure_force.setArg(2, boundary_neighbor_cache);
+		pcisph_update_pressure_force.setArg(3, boundary_positions);
+		pcisph_update_pressure_force.setArg(4, boundary_pressures);
+		pcisph_update_pressure_force.setArg(5, fluid_cell_offsets);
+		pcisph_update_pressure_force.setArg(6, fluid_neighbor_cache);
+		pcisph_update_pressure_force.setArg(8, fluid_densities);
+		pcisph_update_pressure_force.setArg(10, fluid_pressure_forces);
+		pcisph_update_pressure_force.setArg(11, solver_state_buffer);
+		pcisph_update_pressure_force.setArg(13, fluid_other_forces);
+		pcisph_update_pressure_force.setArg(14, fluid_predicted_positions);
+		pcisph_update_pressure_force.setArg(15, symmetric ? fluid_pair_forces : cl::Buffer());
+
+		// -> work-group per cell
+		if(uses_cell_tiles()) {
+			pcisph_update_fluid_pressure_tiled.setArg(0, params_buffer);
+			pcisph_update_fluid_pressure_tiled.setArg(1, boundary_cell_offsets);
+			pcisph_update_fluid_pressure_tiled.setArg(2, boundary_positions);
+			pcisph_update_fluid_pressure_tiled.setArg(3, fluid_cell_offsets);
+			pcisph_update_fluid_pressure_tiled.setArg(5, fluid_predicted_positions);
+			pcisph_update_fluid_pressure_tiled.setArg(6, fluid_density_variations);
+			pcisph_update_fluid_pressure_tiled.setArg(8, solver_state_buffer);
+			pcisph_update_fluid_pressure_tiled.setArg(10, fluid_other_forces);
+			pcisph_update_fluid_pressure_tiled.setArg(11, fluid_pressure_forces);
+			pcisph_update_fluid_pressure_tiled.setArg(12, fluid_occupied_cells);
+			pcisph_update_fluid_pressure_tiled.setArg(13, cl::__local(tile_local_size * sizeof(cl_float4)));
+			pcisph_update_fluid_pressure_tiled.setArg(14, cl::__local(tile_cells_size * sizeof(cl_uint)));
+
+			pcisph_update_pressure_force_tiled.setArg(0, params_buffer);
+			pcisph_update_pressure_force_tiled.setArg(1, boundary_cell_offsets);
+			pcisph_update_pressure_force_tiled.setArg(2, boundary_positions);
+			pcisph_update_pressure_force_tiled.setArg(3, boundary_pressures);
+			pcisph_update_pressure_force_tiled.setArg(4, fluid_cell_offsets);
+			pcisph_update_pressure_force_tiled.setArg(6, fluid_densities);
+			pcisph_update_pressure_force_tiled.setArg(8, fluid_pressure_forces);
+			pcisph_update_pressure_force_tiled.setArg(9, solver_state_buffer);
+			pcisph_update_pressure_force_tiled.setArg(11, fluid_other_forces);
+			pcisph_update_pressure_force_tiled.setArg(12, fluid_predicted_positions);
+			pcisph_update_pressure_force_tiled.setArg(13, fluid_occupied_cells);
+			pcisph_update_pressure_force_tiled.setArg(14, cl::__local(tile_local_size * sizeof(cl_float4)));
+			pcisph_update_pressure_force_tiled.setArg(15, cl::__local(tile_cells_size * sizeof(cl_uint)));
+		}
+
+		// -> density variation reduction
+		reduce_utils_max_and_sum.setArg(0, fluid_count_buffer);
+		reduce_utils_max_and_sum.setArg(1, fluid_density_variations);
+		reduce_utils_max_and_sum.setArg(2, reduce_partial_results);
+		reduce_utils_max_and_sum.setArg(3, cl::__local(reduce_local_size * sizeof(cl_float)));
+		reduce_utils_max_and_sum.setArg(4, cl::__local(reduce_local_size * sizeof(cl_float)));
+
+		reduce_utils_max_and_sum_partials.setArg(0, reduce_group_count);
+		reduce_utils_max_and_sum_partials.setArg(1, reduce_partial_results);
+		reduce_utils_max_and_sum_partials.setArg(2, fluid_density_variation_result);
+		reduce_utils_max_and_sum_partials.setArg(3, cl::__local(reduce_local_size * sizeof(cl_float)));
+		reduce_utils_max_and_sum_partials.setArg(4, cl::__local(reduce_local_size * sizeof(cl_float)));
+
+		// -> on-device convergence check
+		pcisph_reset_solver_state.setArg(0, solver_state_buffer);
+
+		pcisph_update_solver_state.setArg(0, params_buffer);
+		pcisph_update_solver_state.setArg(2, (cl_uint)min_iterations);
+		pcisph_update_solver_state.setArg(3, fluid_density_variation_result);
+		pcisph_update_solver_state.setArg(4, solver_state_buffer);
+		pcisph_update_solver_state.setArg(6, step_iterations_buffer);
+
+		//////////////////////
+		// time integration //
+		pcisph_update_position_and_velocity.setArg(0, params_buffer);
+		pcisph_update_position_and_velocity.setArg(3, fluid_other_forces);
+		pcisph_update_position_and_velocity.setArg(4, fluid_pressure_forces);
+		pcisph_update_position_and_velocity.setArg(7, nullptr);
+
+		// -> particle flow (the batch arguments are set per emission)
+		pcisph_emit_particles.setArg(0, params_buffer);
+		pcisph_emit_particles.setArg(7, fluid_count_buffer);
+
+		bind_particle_state_arguments();
+	}
+
+	void Fluid::bind_particle_state_arguments() {
+		// -> sorting (the attribute gather / scatter reads the front buffers and writes the back buffers).
+		// the pressures are only swapped with the warm start
+		sort_utils_initialize_fluid.setArg(3, fluid_positions);
+		sort_utils_count_fluid_particles_per_cell.setArg(2, fluid_positions);
+		sort_utils_flag_moved_particles.setArg(2, fluid_positions);
+
+		auto persistent_buffers = get_persistent_buffers();
+		for(cl_uint i = 0; i < persistent_buffers.size(); i++) {
+			attribute_gather_fluid.setArg(5 + 2 * i, *persistent_buffers[i].first);
+			attribute_gather_fluid.setArg(6 + 2 * i, *persistent_buffers[i].second);
+			attribute_scatter_fluid.setArg(5 + 2 * i, *persistent_buffers[i].first);
+			attribute_scatter_fluid.setArg(6 + 2 * i, *persistent_buffers[i].second);
+		}
+
+		// -> neighbor caches
+		sort_utils_build_fluid_neighbor_lists.setArg(2, fluid_positions);
+		sort_utils_build_fluid_neighbor_lists.setArg(4, fluid_positions);
+		sort_utils_build_boundary_neighbor_lists.setArg(2, fluid_positions);
+		sort_utils_build_fluid_cell_ranges.setArg(1, fluid_positions);
+		sort_utils_build_boundary_cell_ranges.setArg(1, fluid_positions);
+
+		// -> pcisph
+		pcisph_update_density.setArg(6, fluid_positions);
+		pcisph_update_normal.setArg(3, fluid_positions);
+		pcisph_force_initialization.setArg(3, fluid_positions);
+		pcisph_force_initialization.setArg(6, fluid_velocities);
+		pcisph_force_initialization.setArg(8, fluid_pressures);
+		pcisph_predict_positions.setArg(1, fluid_positions);
+		pcisph_predict_positions.setArg(2, fluid_velocities);
+		pcisph_update_boundary_pressure.setArg(7, fluid_positions);
+		pcisph_update_fluid_pressure.setArg(7, fluid_positions);
+		pcisph_update_pressure_force.setArg(7, fluid_positions);
+		pcisph_update_pressure_force.setArg(12, fluid_velocities);
+		pcisph_update_boundary_pressure.setArg(12, fluid_velocities);
+		pcisph_update_fluid_pressure.setArg(12, fluid_velocities);
+		pcisph_update_fluid_pressure.setArg(10, fluid_pressures);
+		pcisph_update_pressure_force.setArg(9, fluid_pressures);
+		pcisph_accumulate_other_forces.setArg(4, fluid_positions);
+		pcisph_accumulate_other_forces.setArg(7, fluid_velocities);
+		pcisph_accumulate_pressure_forces.setArg(4, fluid_positions);
+		pcisph_accumulate_pressure_forces.setArg(6, fluid_pressures);
+		if(uses_cell_tiles()) {
+			sort_utils_flag_occupied_cells.setArg(1, fluid_positions);
+			pcisph_update_density_tiled.setArg(4, fluid_positions);
+			pcisph_update_fluid_pressure_tiled.setArg(4, fluid_positions);
+			pcisph_update_fluid_pressure_tiled.setArg(7, fluid_pressures);
+			pcisph_update_fluid_pressure_tiled.setArg(9, fluid_velocities);
+			pcisph_update_pressure_force_tiled.setArg(5, fluid_positions);
+			pcisph_update_pressure_force_tiled.setArg(7, fluid_pressures);
+			pcisph_update_pressure_force_tiled.setArg(10, fluid_velocities);
+		}
+		pcisph_update_position_and_velocity.setArg(1, fluid_positions);
+		pcisph_update_position_and_velocity.setArg(2, fluid_velocities);
+		pcisph_update_position_and_velocity.setArg(5, fluid_positions);
+		pcisph_update_position_and_velocity.setArg(6, fluid_velocities);
+		pcisph_emit_particles.setArg(4, fluid_positions);
+		pcisph_emit_particles.setArg(5, fluid_velocities);
+		pcisph_emit_particles.setArg(6, fluid_pressures);
+	}
+
+	void Fluid::swap_particle_buffers() {
+		for(auto& buffers : get_persistent_buffers())
+			std::swap(*buffers.first, *buffers.second);
+		particle_buffers_swapped = !particle_buffers_swapped;
+		bind_particle_state_arguments();
+	}
+
+	void Fluid::prepare() {
+		prepare_update();
+	}
+
+	void Fluid::update() {
+		if(!prepare_update())
+			return;
+
+		// (max, sum) of the density variations, double buffered for the pipelined convergence check
+		cl_float density_variation_results[2][2] = { { 0.f, 0.f }, { 0.f, 0.f } };
+
+		enqueue_particle_emission();
+		enqueue_sort_particles();
+		// -> active count of the sorted particles (particle flow), read while the solver runs
+		cl_uint sorted_fluid_count = params.fluid_count;
+		cl::Event fluid_count_read_ev;
+		if(uses_particle_flow())
+			queue.enqueueReadBuffer(fluid_count_buffer, CL_FALSE, 0, sizeof(cl_uint), &sorted_fluid_count, nullptr, &fluid_count_read_ev);
+		// -> path of the incremental sort, read while the solver runs
+		cl::Event sort_state_read_ev;
+		if(sort_method == Sort_Method::INCREMENTAL)
+			queue.enqueueReadBuffer(fluid_sort_state, CL_FALSE, 0, sizeof(sort_state), sort_state, nullptr, &sort_state_read_ev);
+		// -> overflow of the neighbor lists of this step, checked after the step
+		cl_uint required_list_size = 0;
+		cl::Event required_list_size_read_ev;
+		if(neighbor_search == Neighbor_Search::NEIGHBOR_LIST)
+			queue.enqueueReadBuffer(neighbor_list_required_size_buffer, CL_FALSE, 0, sizeof(cl_uint), &required_list_size, nullptr, &required_list_size_read_ev);
+		solver_statistics.kernel_launches = 0;
+		enqueue_force_initialization();
 		
-		if (params.fluid_count == 0)
+		// PCISPH iterations
+		// -> the convergence is checked on the host, the solver state is never set to converged
+		queue.enqueueTask(pcisph_reset_solver_state);
+		solver_statistics.kernel_launches++;
+		enqueue_pressure_warm_start();
+		solver_statistics.iterations = max_iterations;
+
+		auto is_converged = [&](const cl_float* result) {
+			if(fluid_count_read_ev())
+				fluid_count_read_ev.wait();
+			solver_statistics.max_density_variation = result[0] / params.rest_density;
+			solver_statistics.mean_density_variation = result[1] / std::max(sorted_fluid_count, 1u) / params.rest_density;
+			return solver_statistics.max_density_variation < density_variation_threshold;
+		};
+		// read of the speculatively enqueued iteration (pipelined convergence check only)
+		cl::Event pending_read_ev;
+
+		for (unsigned int i = 0; i < max_iterations; i++) {
+			// -> predict position / predict density / predict density variation / update pressure
+			enqueue_pressure_update();
+
+			// -> reduce density variations on the device and read back the result
+			cl::Event density_variation_read_ev;
+			if(i >= min_iterations) {
+				enqueue_density_variation_reduction();
+				queue.enqueueReadBuffer(fluid_density_variation_result, CL_FALSE, 0, 2 * sizeof(cl_float), density_variation_results[i % 2], nullptr, &density_variation_read_ev);
+			}
+			
+			// -> compute pressure force
+			enqueue_pressure_force_update();
+			
+			// -> check if we can stop (max density variation below threshold)
+			if(i >= min_iterations) {
+				if(pipelined_convergence_check) {
+					// iteration i is already enqueued, so the device stays busy while we check iteration i - 1
+					std::swap(pending_read_ev, density_variation_read_ev);
+					if(i > min_iterations) {
+						queue.flush();
+						density_variation_read_ev.wait();
+						if(is_converged(density_variation_results[(i - 1) % 2])) {
+							solver_statistics.iterations = i + 1;
+							break;
+						}
+					}
+				}
+				else {
+					density_variation_read_ev.wait();
+					if(is_converged(density_variation_results[i % 2])) {
+						solver_statistics.iterations = i + 1;
+						break;
+					}
+				}
+			}
+		}
+
+		enqueue_time_integration();
+
+		// the read of the last (speculative) iteration still targets density_variation_results
+		if(pending_read_ev()) {
+			pending_read_ev.wait();
+			is_converged(density_variation_results[(solver_statistics.iterations - 1) % 2]);
+		}
+		if(fluid_count_read_ev()) {
+			fluid_count_read_ev.wait();
+			params.fluid_count = sorted_fluid_count;
+			max_fluid_count = sorted_fluid_count;
+		}
+		if(required_list_size_read_ev()) {
+			required_list_size_read_ev.wait();
+			handle_neighbor_list_overflow(required_list_size);
+		}
+		if(sort_state_read_ev()) {
+			sort_state_read_ev.wait();
+			update_sort_statistics();
+		}
+	}
+
+	void Fluid::advance(unsigned int step_count) {
+		step_iterations.assign(step_count, 0);
+		if(step_count == 0)
+			return;
+		if(!prepare_update())
 			return;
-		const std::uint32_t local_group_size = 64;
+		// -> per batch scratch buffer, only its own argument is bound again (the solver state stays valid)
+		if(step_iterations_buffer.getInfo<CL_MEM_SIZE>() < step_count * sizeof(cl_uint)) {
+			step_iterations_buffer = cl::Buffer(ctx, CL_MEM_READ_WRITE, step_count * sizeof(cl_uint));
+			pcisph_update_solver_state.setArg(6, step_iterations_buffer);
+		}
+
+		pcisph_update_solver_state.setArg(1, density_variation_threshold);
+		solver_statistics.kernel_launches = 0;
 
-		cl::Buffer params_buffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(Simulation_Params), &params);
-		std::vector<float> density_variations(params.fluid_count);
+		for(unsigned int step = 0; step < step_count; step++) {
+			enqueue_particle_emission();
+			enqueue_sort_particles();
+			enqueue_force_initialization();
 
-		cl::Event first_event, last_event;
+			// PCISPH iterations, the convergence check runs on the device.
+			// once converged, the remaining iterations of the step return immediately
+			queue.enqueueTask(pcisph_reset_solver_state);
+			solver_statistics.kernel_launches++;
+			enqueue_pressure_warm_start();
+			pcisph_update_solver_state.setArg(5, (cl_uint)step);
 
-		auto sort_bit_count = [](unsigned int elements) {
-			unsigned int max_value = 0;
-			for(int i = 0; i < 32; i++) {
-				max_value = (max_value << 1) | 1;
-				if(max_value >= elements - 1)
-					return i + 1;
+			for(unsigned int i = 0; i < max_iterations; i++) {
+				enqueue_pressure_update();
+				if(i >= min_iterations)
+					enqueue_density_variation_reduction();
+				enqueue_pressure_force_update();
+				queue.enqueueTask(pcisph_update_solver_state);
+				solver_statistics.kernel_launches++;
 			}
-			throw std::runtime_error("sort_bit_count failed");
+
+			enqueue_time_integration();
+		}
+
+		// single synchronization for all steps
+		cl_float density_variation_result[2];
+		cl_uint fluid_count = params.fluid_count;
+		if(uses_particle_flow())
+			queue.enqueueReadBuffer(fluid_count_buffer, CL_FALSE, 0, sizeof(cl_uint), &fluid_count);
+		cl_uint required_list_size = 0;
+		if(neighbor_search == Neighbor_Search::NEIGHBOR_LIST)
+			queue.enqueueReadBuffer(neighbor_list_required_size_buffer, CL_FALSE, 0, sizeof(cl_uint), &required_list_size);
+		if(sort_method == Sort_Method::INCREMENTAL)
+			queue.enqueueReadBuffer(fluid_sort_state, CL_FALSE, 0, sizeof(sort_state), sort_state);
+		queue.enqueueReadBuffer(fluid_density_variation_result, CL_FALSE, 0, 2 * sizeof(cl_float), density_variation_result);
+		queue.enqueueReadBuffer(step_iterations_buffer, CL_TRUE, 0, step_count * sizeof(cl_uint), step_iterations.data());
+		params.fluid_count = fluid_count;
+		max_fluid_count = fluid_count;
+
+		handle_neighbor_list_overflow(required_list_size);
+		if(sort_method == Sort_Method::INCREMENTAL)
+			update_sort_statistics();
+
+		solver_statistics.iterations = step_iterations.back();
+		solver_statistics.max_density_variation = density_variation_result[0] / params.rest_density;
+		solver_statistics.mean_density_variation = density_variation_result[1] / std::max(params.fluid_count, 1u) / params.rest_density;
+	}
+
+	void Fluid::enqueue_particle_emission() {
+		// -> at most one batch per emitter and step
+		std::vector<Emitter_State*> due_emitters;
+		std::uint32_t emitted_count = 0;
+		for(auto& state : emitters) {
+			state.time += params.delta_t;
+			if(state.time < state.period)
+				continue;
+			state.time = std::min(state.time - state.period, state.period);
+			due_emitters.push_back(&state);
+			emitted_count += state.count;
+		}
+		if(due_emitters.empty())
+			return;
+
+		// -> the bound may be outdated by removed particles, the exact count is only read if the capacity doesn't suffice
+		if(max_fluid_count + emitted_count > params.fluid_capacity) {
+			read_fluid_count();
+			if(capacity_growth && max_fluid_count + emitted_count > params.fluid_capacity)
+				grow_fluid_capacity(std::max(max_fluid_count + emitted_count, 2 * params.fluid_capacity));
+		}
+
+		// -> appended behind the active particles, the particles exceeding the capacity are dropped
+		for(auto state : due_emitters) {
+			const auto& velocity = state->emitter.velocity;
+			pcisph_emit_particles.setArg(1, (cl_uint)state->count);
+			pcisph_emit_particles.setArg(2, state->positions);
+			pcisph_emit_particles.setArg(3, cl_float4{ { velocity[0], velocity[1], velocity[2], 0.f } });
+			enqueue_kernel(pcisph_emit_particles, state->count);
+			enqueue_fluid_count_update();
+			max_fluid_count = std::min(max_fluid_count + state->count, params.fluid_capacity);
+		}
+	}
+
+	void Fluid::enqueue_fluid_count_update() {
+		queue.enqueueCopyBuffer(fluid_count_buffer, params_buffer, 0, offsetof(Simulation_Params, fluid_count), sizeof(cl_uint));
+	}
+
+	void Fluid::read_fluid_count() {
+		queue.enqueueReadBuffer(fluid_count_buffer, CL_TRUE, 0, sizeof(cl_uint), &params.fluid_count);
+		max_fluid_count = params.fluid_count;
+	}
+
+	void Fluid::grow_fluid_capacity(std::uint32_t capacity) {
+		const std::size_t old_capacity = params.fluid_capacity;
+		params.fluid_capacity = capacity;
+		const auto particle_vec_size = get_particle_vec_size();
+
+		// -> the persistent front buffers keep their particles (copied per component plane in the SoA layout)
+		auto copy_particles = [&](const cl::Buffer& src, const cl::Buffer& dst, const Particle_Attribute& attribute) {
+			if(old_capacity == 0)
+				return;
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+			if(is_particle_vec(attribute)) {
+				for(unsigned int c = 0; c < 3; c++)
+					queue.enqueueCopyBuffer(src, dst, get_particle_vec_offset(old_capacity, 0, c), get_particle_vec_offset(capacity, 0, c), old_capacity * sizeof(cl_float));
+				return;
+			}
+#endif
+			queue.enqueueCopyBuffer(src, dst, 0, 0, old_capacity * attribute_size(attribute, particle_vec_size));
 		};
+		const auto persistent_attributes = get_persistent_attributes();
+		const auto persistent_buffers = get_persistent_buffers();
+		for(std::size_t i = 0; i < persistent_buffers.size(); i++) {
+			const auto size = capacity * attribute_size(persistent_attributes[i], particle_vec_size);
+			cl::Buffer front(ctx, CL_MEM_READ_WRITE, size);
+			copy_particles(*persistent_buffers[i].first, front, persistent_attributes[i]);
+			*persistent_buffers[i].first = front;
+			*persistent_buffers[i].second = cl::Buffer(ctx, CL_MEM_READ_WRITE, size);
+		}
+		particle_buffers_swapped = false;
 
+		// -> all other buffers are recalculated in every step
+		for(auto buffer : { &fluid_normals, &fluid_predicted_positions, &fluid_other_forces, &fluid_pressure_forces })
+			*buffer = cl::Buffer(ctx, CL_MEM_READ_WRITE, capacity * particle_vec_size);
+		fluid_densities = cl::Buffer(ctx, CL_MEM_READ_WRITE, capacity * sizeof(cl_float));
+		if(pressure_warm_start == 0.f)
+			fluid_pressures = cl::Buffer(ctx, CL_MEM_READ_WRITE, capacity * sizeof(cl_float));
+		for(auto& buffers : attributes) {
+			if(!buffers.attribute.persistent)
+				buffers.front = cl::Buffer(ctx, CL_MEM_READ_WRITE, capacity * attribute_size(buffers.attribute, particle_vec_size));
+		}
+		allocate_fluid_buffers();
+		allocate_search_buffers();
+
+		// -> the host count is exact (see enqueue_particle_emission)
+		queue.enqueueWriteBuffer(params_buffer, CL_TRUE, 0, sizeof(Simulation_Params), &params);
+		checkBuffersConsistent();
+		bind_kernel_arguments();
+		bound_buffer_handles = get_buffer_handles();
+		sorted_keys_valid = false;
+	}
+
+	void Fluid::enqueue_sort_particles() {
 		if(boundary_updated && params.boundary_count > 0) {
 			/////////////////////////////
 			// sort boundary particles //
 
 			// -> reset offsets
-			sort_utils_reset_cell_offsets.setArg(0, params_buffer);
-			sort_utils_reset_cell_offsets.setArg(1, boundary_cell_offsets);
-			queue.enqueueNDRangeKernel(sort_utils_reset_cell_offsets, cl::NDRange(0), make_NDRange(params.bucket_count, local_group_size), local_group_size, 0, nullptr);
+			enqueue_kernel(sort_utils_reset_boundary_cell_offsets, params.bucket_count);
 
 			// -> initialize
-			sort_utils_initialize.setArg(0, params_buffer);
-			sort_utils_initialize.setArg(1, params.boundary_count);
-			sort_utils_initialize.setArg(2, boundary_keys);
-			sort_utils_initialize.setArg(3, boundary_positions);
-			sort_utils_initialize.setArg(4, boundary_src_locations);
-			queue.enqueueNDRangeKernel(sort_utils_initialize, cl::NDRange(0), make_NDRange(params.boundary_count, local_group_size), local_group_size, 0, 0);
+			enqueue_kernel(sort_utils_initialize_boundary, params.boundary_count);
 
 			// -> sort
-			radixsort->enqueue(queue, boundary_keys, boundary_src_locations, params.boundary_count, sort_bit_count(params.boundary_count));
+			radixsort->enqueue(queue, boundary_keys, boundary_src_locations, params.boundary_count, sort_bit_count(params.bucket_count));
 
 			// -> reorder
-			queue.enqueueCopyBuffer(boundary_positions, boundary_positions_tmp, 0, 0, 3 * params.boundary_count * sizeof(cl_float));
-
-			sort_utils_reorder_and_insert_boundary_offsets.setArg(0, (cl_uint)params.boundary_count);
-			sort_utils_reorder_and_insert_boundary_offsets.setArg(1, boundary_cell_offsets);
-			sort_utils_reorder_and_insert_boundary_offsets.setArg(2, boundary_src_locations);
-			sort_utils_reorder_and_insert_boundary_offsets.setArg(3, boundary_keys);
-			sort_utils_reorder_and_insert_boundary_offsets.setArg(4, boundary_positions_tmp);
-			sort_utils_reorder_and_insert_boundary_offsets.setArg(5, boundary_positions);
-			queue.enqueueNDRangeKernel(sort_utils_reorder_and_insert_boundary_offsets, cl::NDRange(0), make_NDRange(params.boundary_count, local_group_size), local_group_size);
-
-			/////////////////////////////////////////////////////////////
-			// initialize predicted densities for boundary VS boundary //
-			pcisph_initialize_boundary_boundary_pred_densities.setArg(0, params_buffer);
-			pcisph_initialize_boundary_boundary_pred_densities.setArg(1, boundary_cell_offsets);
-			pcisph_initialize_boundary_boundary_pred_densities.setArg(2, boundary_positions);
-			pcisph_initialize_boundary_boundary_pred_densities.setArg(3, boundary_init_pred_densities);
+			queue.enqueueCopyBuffer(boundary_positions, boundary_positions_tmp, 0, 0, params.boundary_count * get_particle_vec_size());
+			enqueue_kernel(sort_utils_reorder_and_insert_boundary_offsets, params.boundary_count);
 
+			// -> the boundary pressures belong to the previous order
 			boundary_updated = false;
+			warm_pressures_valid = false;
 		}
 
 		//////////////////////////
 		// sort fluid particles //
+		// -> over the bound of the active count. with particle flow the removed particles and the free slots get the key
+		// bucket_count and are sorted behind the active ones, the sort writes the new active count
+		const bool flow = uses_particle_flow();
+		const cl_uint particle_count = max_fluid_count;
+		sort_utils_initialize_fluid.setArg(1, particle_count);
+		sort_utils_count_fluid_particles_per_cell.setArg(1, particle_count);
+		attribute_gather_fluid.setArg(1, particle_count);
+		attribute_scatter_fluid.setArg(1, particle_count);
+		if(sort_method == Sort_Method::COUNTING) {
+			// the keys aren't stored in sorted order
+			sorted_keys_valid = false;
+
+			// -> count particles per cell
+			enqueue_kernel(sort_utils_reset_fluid_cell_counts, params.bucket_count + 1);
+			enqueue_kernel(sort_utils_count_fluid_particles_per_cell, particle_count);
+
+			// -> counts to cell starts (the last entry becomes the active count) 
+			scan->enqueue(queue, fluid_cell_starts, params.bucket_count + 1);
+			enqueue_kernel(sort_utils_insert_counted_fluid_cell_offsets, params.bucket_count);
+
+			// -> scatter
+			enqueue_kernel(attribute_scatter_fluid, particle_count);
+			if(flow) {
+				queue.enqueueCopyBuffer(fluid_cell_starts, fluid_count_buffer, params.bucket_count * sizeof(cl_uint), 0, sizeof(cl_uint));
+				enqueue_fluid_count_update();
+			}
+		}
+		else {
+			// -> reset offsets
+			enqueue_kernel(sort_utils_reset_fluid_cell_offsets, params.bucket_count);
 
-		// -> reset offsets
-		sort_utils_reset_cell_offsets.setArg(0, params_buffer);
-		sort_utils_reset_cell_offsets.setArg(1, fluid_cell_offsets);
-		queue.enqueueNDRangeKernel(sort_utils_reset_cell_offsets, cl::NDRange(0), make_NDRange(params.bucket_count, local_group_size), local_group_size, 0, &first_event);
-
-		// -> initialize
-		sort_utils_initialize.setArg(0, params_buffer);
-		sort_utils_initialize.setArg(1, params.fluid_count);
-		sort_utils_initialize.setArg(2, fluid_keys);
-		sort_utils_initialize.setArg(3, fluid_positions);
-		sort_utils_initialize.setArg(4, fluid_src_locations);
-		queue.enqueueNDRangeKernel(sort_utils_initialize, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, 0);
+			// -> incremental sort (the keys of the last step are still sorted and the particle count is fixed).
+			// the path is chosen on the device: the movers are sorted over the threshold, more movers fall back to a counting sort
+			// of the keys (the scan of the cell counts is enqueued for both paths)
+			bool sorted = false;
+			if(sort_method == Sort_Method::INCREMENTAL && sorted_keys_valid && !flow) {
+				const cl_uint mover_capacity = static_cast<cl_uint>(incremental_sort_threshold * params.fluid_count);
+				enqueue_kernel(sort_utils_flag_moved_particles, params.fluid_count);
+				scan->enqueue(queue, fluid_moved_flags, fluid_mover_offsets, params.fluid_count + 1);
+
+				sort_utils_select_sort_path.setArg(1, mover_capacity);
+				queue.enqueueTask(sort_utils_select_sort_path);
+				enqueue_kernel(sort_utils_reset_fallback_cell_counts, params.bucket_count + 1);
+				sort_utils_gather_moved_particles.setArg(2, mover_capacity);
+				enqueue_kernel(sort_utils_gather_moved_particles, params.fluid_count);
+
+				// -> the padded mover keys (bucket_count) are sorted behind the movers
+				if(mover_capacity > 0)
+					radixsort->enqueue(queue, fluid_mover_keys, fluid_mover_ids, mover_capacity, sort_bit_count(params.bucket_count + 1));
+				scan->enqueue(queue, fluid_cell_starts, params.bucket_count + 1);
+				enqueue_kernel(sort_utils_merge_moved_particles, params.fluid_count);
+				sorted = true;
+			}
+
+			if(!sorted) {
+				// -> initialize
+				enqueue_kernel(sort_utils_initialize_fluid, particle_count);
 		
-		// -> sort
-		radixsort->enqueue(queue, fluid_keys, fluid_src_locations, params.fluid_count, sort_bit_count(params.fluid_count));
+				// -> sort (the removed particles need the key bucket_count)
+				if(particle_count > 0)
+					radixsort->enqueue(queue, fluid_keys, fluid_src_locations, particle_count, sort_bit_count(flow ? params.bucket_count + 1 : params.bucket_count));
+				if(sort_method == Sort_Method::INCREMENTAL)
+					sort_statistics.full_sorts++;
+			}
+			sorted_keys_valid = true;
 		
-		// -> reorder
-		queue.enqueueCopyBuffer(fluid_positions, fluid_positions_tmp, 0, 0, 3 * params.fluid_count * sizeof(cl_float));
-		queue.enqueueCopyBuffer(fluid_velocities, fluid_velocities_tmp, 0, 0, 3 * params.fluid_count * sizeof(cl_float));
-
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(0, (cl_uint)params.fluid_count);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(1, fluid_cell_offsets);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(2, fluid_src_locations);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(3, fluid_keys);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(4, fluid_positions_tmp);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(5, fluid_velocities_tmp);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(6, fluid_positions);
-		sort_utils_reorder_and_insert_fluid_offsets.setArg(7, fluid_velocities);
-		queue.enqueueNDRangeKernel(sort_utils_reorder_and_insert_fluid_offsets, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size);
+			// -> reorder
+			enqueue_kernel(attribute_gather_fluid, particle_count);
+			if(flow) {
+				sort_utils_update_sorted_fluid_count.setArg(1, particle_count);
+				enqueue_kernel(sort_utils_update_sorted_fluid_count, particle_count);
+				enqueue_fluid_count_update();
+			}
+		}
 
-		///////////////////////
-		// Actual simulation //
+		// -> the sorted particles are in the back buffers
+		swap_particle_buffers();
+
+		// -> neighbor caches are built once and used by all kernels of the step
+		if(neighbor_search == Neighbor_Search::NEIGHBOR_LIST) {
+			enqueue_kernel(sort_utils_build_fluid_neighbor_lists, max_fluid_count);
+			if(params.boundary_count > 0)
+				enqueue_kernel(sort_utils_build_boundary_neighbor_lists, max_fluid_count);
+		}
+		else if(neighbor_search == Neighbor_Search::CELL_RANGES) {
+			enqueue_kernel(sort_utils_build_fluid_cell_ranges, max_fluid_count);
+			if(params.boundary_count > 0)
+				enqueue_kernel(sort_utils_build_boundary_cell_ranges, max_fluid_count);
+		}
+
+		// -> occupied cells of the work-group per cell kernels (the last index is the cell count)
+		if(uses_cell_tiles()) {
+			enqueue_kernel(sort_utils_flag_occupied_cells, max_fluid_count);
+			scan->enqueue(queue, fluid_occupied_cell_indices, max_fluid_count + 1);
+			enqueue_kernel(sort_utils_compact_occupied_cells, max_fluid_count);
+		}
+	}
 
+	void Fluid::enqueue_force_initialization() {
 		// calculate density
-		cl::Event density_event;
-		pcisph_update_density.setArg(0, params_buffer);
-		pcisph_update_density.setArg(1, boundary_cell_offsets);
-		pcisph_update_density.setArg(2, boundary_positions);
-		pcisph_update_density.setArg(3, fluid_cell_offsets);
-		pcisph_update_density.setArg(4, fluid_positions);
-		pcisph_update_density.setArg(5, fluid_densities);
-		queue.enqueueNDRangeKernel(pcisph_update_density, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, &density_event);
+		if(uses_cell_tiles())
+			enqueue_tiled_kernel(pcisph_update_density_tiled);
+		else
+			enqueue_pcisph_kernel(pcisph_update_density, max_fluid_count);
 
 		// calculate normal
-		pcisph_update_normal.setArg(0, params_buffer);
-		pcisph_update_normal.setArg(1, fluid_cell_offsets);
-		pcisph_update_normal.setArg(2, fluid_positions);
-		pcisph_update_normal.setArg(3, fluid_densities);
-		pcisph_update_normal.setArg(4, fluid_normals);
-		queue.enqueueNDRangeKernel(pcisph_update_normal, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, 0);
+		enqueue_pcisph_kernel(pcisph_update_normal, max_fluid_count);
 
-		// initialize boundary pressure
+		// initialize boundary pressure (warm start: pressures of the previous step)
+		const cl_float warm_start = warm_pressures_valid ? pressure_warm_start : 0.f;
 		if(params.boundary_count > 0) {
-			pcisph_boundary_pressure_initialization.setArg(0, params_buffer);
-			pcisph_boundary_pressure_initialization.setArg(1, boundary_pressures);
-			queue.enqueueNDRangeKernel(pcisph_boundary_pressure_initialization, cl::NDRange(0), make_NDRange(params.boundary_count, local_group_size), local_group_size, 0, 0);
+			pcisph_boundary_pressure_initialization.setArg(2, warm_start);
+			enqueue_pcisph_kernel(pcisph_boundary_pressure_initialization, params.boundary_count);
 		}
 
 		// calculate viscosity/surface tension
-		pcisph_force_initialization.setArg(0, params_buffer);
-		pcisph_force_initialization.setArg(1, fluid_cell_offsets);
-		pcisph_force_initialization.setArg(2, fluid_positions);
-		pcisph_force_initialization.setArg(3, fluid_normals);
-		pcisph_force_initialization.setArg(4, fluid_densities);
-		pcisph_force_initialization.setArg(5, fluid_velocities);
-		pcisph_force_initialization.setArg(6, fluid_other_forces);
-		pcisph_force_initialization.setArg(7, fluid_pressures);
-		pcisph_force_initialization.setArg(8, fluid_pressure_forces);
-		queue.enqueueNDRangeKernel(pcisph_force_initialization, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, 0);
-		
-		// PCISPH iterations
-		const int min_iterations = 2;
-		for (int i = 0; i < 7; i++) {
-			// -> predict position
-			pcisph_update_position_and_velocity.setArg(0, params_buffer);
-			pcisph_update_position_and_velocity.setArg(1, fluid_positions);
-			pcisph_update_position_and_velocity.setArg(2, fluid_velocities);
-			pcisph_update_position_and_velocity.setArg(3, fluid_other_forces);
-			pcisph_update_position_and_velocity.setArg(4, fluid_pressure_forces);
-			pcisph_update_position_and_velocity.setArg(5, fluid_predicted_positions);
-			pcisph_update_position_and_velocity.setArg(6, nullptr);
-			queue.enqueueNDRangeKernel(pcisph_update_position_and_velocity, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, 0);
-			
-			// -> predict density / predict density variation / update pressure
-			pcisph_update_pressure.setArg(0, params_buffer);
-			pcisph_update_pressure.setArg(1, 1);
-			pcisph_update_pressure.setArg(2, boundary_cell_offsets);
-			pcisph_update_pressure.setArg(3, boundary_positions);
-			pcisph_update_pressure.setArg(4, boundary_init_pred_densities);
-			pcisph_update_pressure.setArg(5, fluid_cell_offsets);
-			pcisph_update_pressure.setArg(6, fluid_positions);
-			pcisph_update_pressure.setArg(7, fluid_predicted_positions);
-			pcisph_update_pressure.setArg(8, nullptr);
-			pcisph_update_pressure.setArg(9, boundary_pressures);
-			if(params.boundary_count > 0) {
-				queue.enqueueNDRangeKernel(pcisph_update_pressure, cl::NDRange(0), make_NDRange(params.boundary_count, local_group_size), local_group_size, 0, 0);
-			}
+		if(pair_evaluation == Pair_Evaluation::SYMMETRIC)
+			enqueue_pcisph_kernel(pcisph_accumulate_other_forces, max_fluid_count);
+		pcisph_force_initialization.setArg(12, warm_start);
+		enqueue_pcisph_kernel(pcisph_force_initialization, max_fluid_count);
+	}
 
-			pcisph_update_pressure.setArg(1, 0);
-			pcisph_update_pressure.setArg(8, fluid_density_variations);
-			pcisph_update_pressure.setArg(9, fluid_pressures);
-			queue.enqueueNDRangeKernel(pcisph_update_pressure, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, 0);
+	void Fluid::enqueue_pressure_warm_start() {
+		// -> the pressures of this step are reordered with the particles of the next one
+		const bool warm_started = warm_pressures_valid && pressure_warm_start > 0.f;
+		warm_pressures_valid = pressure_warm_start > 0.f;
+		if(warm_started)
+			enqueue_pressure_force_update();
+	}
 
-			// -> read density variations
-			cl::Event density_variation_read_ev;
-			if(i >= min_iterations) {
-				queue.enqueueReadBuffer(fluid_density_variations, CL_FALSE, 0, params.fluid_count * sizeof(float), density_variations.data(), nullptr, &density_variation_read_ev);
-			}
-			
-			// -> compute pressure force
-			pcisph_update_pressure_force.setArg(0, params_buffer);
-			pcisph_update_pressure_force.setArg(1, boundary_cell_offsets);
-			pcisph_update_pressure_force.setArg(2, boundary_positions);
-			pcisph_update_pressure_force.setArg(3, boundary_pressures);
-			pcisph_update_pressure_force.setArg(4, fluid_cell_offsets);
-			pcisph_update_pressure_force.setArg(5, fluid_positions);
-			pcisph_update_pressure_force.setArg(6, fluid_densities);
-			pcisph_update_pressure_force.setArg(7, fluid_pressures);
-			pcisph_update_pressure_force.setArg(8, fluid_pressure_forces);
-			queue.enqueueNDRangeKernel(pcisph_update_pressure_force, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, 0);
+	void Fluid::enqueue_pressure_update() {
+		// -> predict position (fused into the force kernels or the pressure kernels otherwise)
+		if(params.kernel_fusion == KERNEL_FUSION_NONE)
+			enqueue_pcisph_kernel(pcisph_predict_positions, max_fluid_count);
 			
-			// -> check if we can stop (max density variation below threshold)
-			if(i >= min_iterations) {
-				density_variation_read_ev.wait();
-				float max_density_variation = *std::max_element(density_variations.begin(), density_variations.end());
-				if(max_density_variation / params.rest_density < density_variation_threshold)
-					break;
-			}
+		// -> predict density / predict density variation / update pressure
+		if(params.boundary_count > 0) {
+			enqueue_pcisph_kernel(pcisph_update_boundary_pressure, params.boundary_count);
 		}
-		// time integration
-		pcisph_update_position_and_velocity.setArg(0, params_buffer);
-		pcisph_update_position_and_velocity.setArg(1, fluid_positions);
-		pcisph_update_position_and_velocity.setArg(2, fluid_velocities);
-		pcisph_update_position_and_velocity.setArg(3, fluid_other_forces);
-		pcisph_update_position_and_velocity.setArg(4, fluid_pressure_forces);
-		pcisph_update_position_and_velocity.setArg(5, fluid_positions);
-		pcisph_update_position_and_velocity.setArg(6, fluid_velocities);
-		queue.enqueueNDRangeKernel(pcisph_update_position_and_velocity, cl::NDRange(0), make_NDRange(params.fluid_count, local_group_size), local_group_size, 0, &last_event);
+		if(uses_cell_tiles())
+			enqueue_tiled_kernel(pcisph_update_fluid_pressure_tiled);
+		else
+			enqueue_pcisph_kernel(pcisph_update_fluid_pressure, max_fluid_count);
+	}
 
+	void Fluid::enqueue_pressure_force_update() {
+		// -> the symmetric pair evaluation replaces the tiled kernel
+		if(pair_evaluation == Pair_Evaluation::SYMMETRIC) {
+			enqueue_pcisph_kernel(pcisph_accumulate_pressure_forces, max_fluid_count);
+			enqueue_pcisph_kernel(pcisph_update_pressure_force, max_fluid_count);
+		}
+		else if(uses_cell_tiles())
+			enqueue_tiled_kernel(pcisph_update_pressure_force_tiled);
+		else
+			enqueue_pcisph_kernel(pcisph_update_pressure_force, max_fluid_count);
+	}
 
-#if 0
-		queue.finish();
-		auto start = first_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-		auto end = last_event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+	void Fluid::enqueue_time_integration() {
+		enqueue_pcisph_kernel(pcisph_update_position_and_velocity, max_fluid_count);
+	}
 
-		auto duration = end - start;
-		std::cout << duration / 1000000.f << "ms" << std::endl;
-#endif
+	void Fluid::enqueue_density_variation_reduction() {
+		// -> one (max, sum) pair per work-group
+		queue.enqueueNDRangeKernel(reduce_utils_max_and_sum, cl::NDRange(0), reduce_group_count * reduce_local_size, reduce_local_size);
+
+		// -> final pair
+		queue.enqueueNDRangeKernel(reduce_utils_max_and_sum_partials, cl::NDRange(0), reduce_local_size, reduce_local_size);
+		solver_statistics.kernel_launches += 2;
+	}
+
+	void Fluid::enqueue_pcisph_kernel(cl::Kernel& kernel, std::uint32_t count) {
+		enqueue_kernel(kernel, count);
+		solver_statistics.kernel_launches++;
+	}
+
+	void Fluid::enqueue_kernel(cl::Kernel& kernel, std::uint32_t count) {
+		if(count == 0)
+			return;
+		auto config = kernel_launch_configs.find(kernel());
+		if(config == kernel_launch_configs.end()) {
+			// -> the reported name may contain the terminating zero
+			const std::string name = kernel.getInfo<CL_KERNEL_FUNCTION_NAME>().c_str();
+			auto stored = local_sizes.find(name);
+			std::uint32_t local_size = stored != local_sizes.end() ? stored->second : default_local_size;
+			// -> limited by the kernel (registers, local memory), halved to keep powers of two
+			const auto max_local_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+			while(local_size > max_local_size && local_size > 1)
+				local_size /= 2;
+			config = kernel_launch_configs.insert(std::make_pair(kernel(), std::make_pair(name, local_size))).first;
+		}
+
+		const auto local_size = config->second.second;
+		if(!kernel_profiling) {
+			queue.enqueueNDRangeKernel(kernel, cl::NDRange(0), make_NDRange(count, local_size), local_size);
+			return;
+		}
+		cl::Event event;
+		queue.enqueueNDRangeKernel(kernel, cl::NDRange(0), make_NDRange(count, local_size), local_size, nullptr, &event);
+		profiled_launches.push_back(std::make_pair(config->second.first, event));
+		kernel_profile[config->second.first].local_size = local_size;
+		if(profiled_launches.size() >= max_profiled_launches)
+			collect_kernel_profile();
+	}
+
+	void Fluid::collect_kernel_profile() {
+		for(auto& launch : profiled_launches) {
+			launch.second.wait();
+			const auto start = launch.second.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+			const auto end = launch.second.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			auto& profile = kernel_profile[launch.first];
+			profile.time_ms += (end - start) * 1e-6;
+			profile.launches++;
+		}
+		profiled_launches.clear();
+	}
+
+	void Fluid::set_local_sizes(const Local_Sizes& local_sizes) {
+		this->local_sizes = local_sizes;
+		kernel_launch_configs.clear();
+	}
+
+	void Fluid::set_default_local_size(std::uint32_t local_size) {
+		default_local_size = local_size;
+		kernel_launch_configs.clear();
+	}
+
+	void Fluid::set_kernel_profiling(bool enabled) {
+		kernel_profiling = enabled;
+	}
+
+	std::map<std::string, Kernel_Profile> Fluid::get_kernel_profile() {
+		collect_kernel_profile();
+		std::map<std::string, Kernel_Profile> result;
+		std::swap(result, kernel_profile);
+		return result;
+	}
+
+	void Fluid::enqueue_tiled_kernel(cl::Kernel& kernel) {
+		queue.enqueueNDRangeKernel(kernel, cl::NDRange(0), tile_group_count * tile_local_size, tile_local_size);
+		solver_statistics.kernel_launches++;
 	}
 
 	const Simulation_Params& Fluid::get_params() const {
 		return params;
 	}
 
+	const std::string& Fluid::get_build_params() const {
+		return build_params;
+	}
+
+	const Solver_Statistics& Fluid::get_solver_statistics() const {
+		return solver_statistics;
+	}
+
+	const std::vector<unsigned int>& Fluid::get_step_iterations() const {
+		return step_iterations;
+	}
+
+	const Sort_Statistics& Fluid::get_sort_statistics() const {
+		return sort_statistics;
+	}
+
+	void Fluid::update_sort_statistics() {
+		// -> differences since the last read (unsigned, correct across a wrap around)
+		const cl_uint full_sorts = sort_state[1] - read_sort_counters[0];
+		const cl_uint incremental_sorts = sort_state[2] - read_sort_counters[1];
+		const cl_uint moved_particles = sort_state[3] - read_sort_counters[2];
+		sort_statistics.full_sorts += full_sorts;
+		sort_statistics.incremental_sorts += incremental_sorts;
+		sort_statistics.moved_particles += moved_particles;
+		std::copy(sort_state + 1, sort_state + 4, read_sort_counters);
+	}
+
+	bool Fluid::are_particle_buffers_swapped() const {
+		return particle_buffers_swapped;
+	}
+
+	unsigned int Fluid::add_attribute(const Particle_Attribute& attribute) {
+		auto is_identifier_char = [](char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		};
+		if(attribute.name.empty() || !std::all_of(attribute.name.begin(), attribute.name.end(), is_identifier_char))
+			throw std::runtime_error("Invalid attribute name: " + attribute.name);
+		if(attribute.width == 0)
+			throw std::runtime_error("Invalid attribute width: " + attribute.name);
+		for(const auto& other : get_persistent_attributes()) {
+			if(other.name == attribute.name)
+				throw std::runtime_error("Duplicate attribute: " + attribute.name);
+		}
+
+		attributes.push_back({ attribute, cl::Buffer(), cl::Buffer() });
+		allocate_attribute_buffers();
+		if(attribute.persistent)
+			attribute_kernels_outdated = true;
+		return (unsigned int) attributes.size() - 1;
+	}
+
+	cl::Buffer& Fluid::get_attribute_buffer(unsigned int id) {
+		return attributes.at(id).front;
+	}
+
+	void Fluid::allocate_attribute_buffers() {
+		for(auto& buffers : attributes) {
+			// all attribute types have 4 bytes
+			const std::size_t size = std::max((std::size_t) 1, params.fluid_capacity * attribute_size(buffers.attribute, get_particle_vec_size()));
+			if(buffers.front() && buffers.front.getInfo<CL_MEM_SIZE>() == size)
+				continue;
+			buffers.front = cl::Buffer(ctx, CL_MEM_READ_WRITE, size);
+			if(buffers.attribute.persistent)
+				buffers.back = cl::Buffer(ctx, CL_MEM_READ_WRITE, size);
+		}
+	}
+
+	std::vector<Particle_Attribute> Fluid::get_persistent_attributes() const {
+		std::vector<Particle_Attribute> result = {
+			{ "positions", Attribute_Type::FLOAT, 3, true },
+			{ "velocities", Attribute_Type::FLOAT, 3, true }
+		};
+		if(pressure_warm_start > 0.f)
+			result.push_back({ "pressures", Attribute_Type::FLOAT, 1, true });
+		for(const auto& buffers : attributes) {
+			if(buffers.attribute.persistent)
+				result.push_back(buffers.attribute);
+		}
+		return result;
+	}
+
+	std::vector<std::pair<cl::Buffer*, cl::Buffer*>> Fluid::get_persistent_buffers() {
+		// same order as get_persistent_attributes
+		std::vector<std::pair<cl::Buffer*, cl::Buffer*>> result = {
+			{ &fluid_positions, &fluid_positions_back },
+			{ &fluid_velocities, &fluid_velocities_back }
+		};
+		if(pressure_warm_start > 0.f)
+			result.push_back({ &fluid_pressures, &fluid_pressures_back });
+		for(auto& buffers : attributes) {
+			if(buffers.attribute.persistent)
+				result.push_back({ &buffers.front, &buffers.back });
+		}
+		return result;
+	}
+
+	void Fluid::build_attribute_kernels() {
+		auto source = resolve_kernel_includes(generate_attribute_kernels(get_persistent_attributes()));
+		try {
+			build_cached_program(ctx, device, source, build_params, attribute_prog);
+			attribute_gather_fluid = cl::Kernel(attribute_prog, "gather_fluid_attributes");
+			attribute_scatter_fluid = cl::Kernel(attribute_prog, "scatter_fluid_attributes");
+			kernel_launch_configs.clear();
+		}
+		catch(cl::Error&) {
+			std::cout << "attribute_prog program failed to build" << std::endl;
+			std::cout << source << std::endl;
+			std::cout << attribute_prog.getBuildInfo<CL_PROGRAM_BUILD_LOG>(this->device) << std::endl;
+			std::getchar();
+			std::rethrow_exception(std::current_exception());
+		}
+	}
+
+	void Fluid::invalidate_params(Param_Change change) {
+		params_changed = std::max(params_changed, change);
+	}
+
+	void Fluid::steer_physical_param(float& param, float value) {
+		// -> the first change after the programs were built leaves the physical constants in the parameter buffer, the programs
+		//    are rebuilt once instead of for every new value. setting the same value again (e.g. by a scene) keeps them folded.
+		//    the rebuild starts right away on worker threads, the next update waits for it
+		const bool first_change = !build_params.empty() && param != value && !steered_params;
+		if(first_change)
+			steered_params = true;
+		param = value;
+		invalidate_params(Param_Change::CONSTANTS);
+		if(first_change && program_specialization)
+			start_program_builds();
+	}
+
 	void Fluid::set_boundary_count(unsigned int boundary_count) {
 		params.boundary_count = boundary_count;
-		params_changed = true;
+		invalidate_params(Param_Change::BUFFERS);
 	}
 
 	void Fluid::set_fluid_count(unsigned int fluid_count) {
 		params.fluid_count = fluid_count;
-		params_changed = true;
+		initial_fluid_count = fluid_count;
+		params.fluid_capacity = std::max(fluid_count, reserved_fluid_capacity);
+		invalidate_params(Param_Change::BUFFERS);
+	}
+
+	void Fluid::set_fluid_capacity(unsigned int capacity) {
+		reserved_fluid_capacity = capacity;
+		params.fluid_capacity = std::max(initial_fluid_count, capacity);
+		invalidate_params(Param_Change::BUFFERS);
 	}
 
 	void Fluid::set_delta_t(float delta_t) {
+		// -> not constant-folded
 		params.delta_t = delta_t;
-		params_changed = true;
+		invalidate_params(Param_Change::CONSTANTS);
 	}
 
 	void Fluid::set_rest_density(float rest_density) {
-		params.rest_density = rest_density;
-		params_changed = true;
+		steer_physical_param(params.rest_density, rest_density);
 	}
 
 	void Fluid::set_particle_radius(float particle_radius) {
+		// -> the kernel radius is the cell size
 		params.particle_radius = particle_radius;
-		params_changed = true;
+		invalidate_params(Param_Change::GRID);
 	}
 
 	void Fluid::set_gravity(float gravity) {
-		params.gravity = gravity;
-		params_changed = true;
+		steer_physical_param(params.gravity, gravity);
 	}
 
 	void Fluid::set_viscosity(float viscosity) {
-		params.viscosity_constant = viscosity;
-		params_changed = true;
+		steer_physical_param(params.viscosity_constant, viscosity);
 	}
 
 	void Fluid::set_surface_tension(float surface_tension_coefficient) {
-		params.surface_tension_coefficient = surface_tension_coefficient;
-		params_changed = true;
+		steer_physical_param(params.surface_tension_coefficient, surface_tension_coefficient);
 	}
 
 	void Fluid::set_density_variation_threshold(float density_variation_threshold) {
 		this->density_variation_threshold = density_variation_threshold;
 	}
 
-	void Fluid::update_deduced_attributes() {
+	void Fluid::set_pipelined_convergence_check(bool enabled) {
+		pipelined_convergence_check = enabled;
+	}
+
+	void Fluid::set_pressure_warm_start(float factor) {
+		// -> the pressures are a persistent attribute while the warm start is enabled
+		if((factor > 0.f) != (pressure_warm_start > 0.f))
+			attribute_kernels_outdated = true;
+		pressure_warm_start = std::max(factor, 0.f);
+		warm_pressures_valid = false;
+	}
+
+	void Fluid::set_neighbor_search(Neighbor_Search neighbor_search) {
+		this->neighbor_search = neighbor_search;
+		params.neighbor_search = static_cast<cl_uint>(neighbor_search);
+		invalidate_params(Param_Change::CONSTANTS);
+		// -> the neighbor caches are allocated with the kernel arguments
+		kernel_arguments_outdated = true;
+	}
+
+	void Fluid::set_grid_type(Grid_Type grid_type) {
+		params.grid_type = static_cast<cl_uint>(grid_type);
+		invalidate_params(Param_Change::GRID);
+	}
+
+	void Fluid::set_cell_ordering(Cell_Ordering cell_ordering) {
+		params.cell_ordering = static_cast<cl_uint>(cell_ordering);
+		invalidate_params(Param_Change::GRID);
+	}
+
+	void Fluid::set_sort_method(Sort_Method sort_method) {
+		this->sort_method = sort_method;
+		kernel_arguments_outdated = true;
+	}
+
+	void Fluid::set_incremental_sort_threshold(float threshold) {
+		incremental_sort_threshold = threshold;
+	}
+
+	void Fluid::set_domain(const std::array<float, 3>& lower, const std::array<float, 3>& upper) {
+		domain_lower = lower;
+		domain_upper = upper;
+		update_position_quantization();
+		invalidate_params(Param_Change::GRID);
+	}
+
+	void Fluid::set_kernel_fusion(Kernel_Fusion kernel_fusion) {
+		params.kernel_fusion = static_cast<cl_uint>(kernel_fusion);
+		invalidate_params(Param_Change::CONSTANTS);
+		kernel_arguments_outdated = true;
+	}
+
+	void Fluid::set_work_distribution(Work_Distribution work_distribution) {
+		this->work_distribution = work_distribution;
+		kernel_arguments_outdated = true;
+	}
+
+	void Fluid::set_pair_evaluation(Pair_Evaluation pair_evaluation) {
+		this->pair_evaluation = pair_evaluation;
+		kernel_arguments_outdated = true;
+	}
+
+	bool Fluid::uses_particle_flow() const {
+		return !emitters.empty() || !sinks.empty() || domain_culling;
+	}
+
+	void Fluid::set_capacity_growth(bool enabled) {
+		capacity_growth = enabled;
+	}
+
+	void Fluid::add_emitter(const Fluid_Emitter& emitter) {
+		// -> lattice inside of the box
+		const float spacing = 2.f * params.particle_radius;
+		std::vector<float> positions;
+		for(float z = emitter.lower[2]; z <= emitter.upper[2]; z += spacing) {
+			for(float y = emitter.lower[1]; y <= emitter.upper[1]; y += spacing) {
+				for(float x = emitter.lower[0]; x <= emitter.upper[0]; x += spacing) {
+					positions.push_back(x);
+					positions.push_back(y);
+					positions.push_back(z);
+				}
+			}
+		}
+		if(positions.empty())
+			throw std::runtime_error("The emitter box contains no particles");
+
+		// -> time until the batch has left the box along the fastest axis
+		float period = std::numeric_limits<float>::max();
+		for(int i = 0; i < 3; i++) {
+			if(emitter.velocity[i] != 0.f)
+				period = std::min(period, (emitter.upper[i] - emitter.lower[i] + spacing) / std::abs(emitter.velocity[i]));
+		}
+		if(period == std::numeric_limits<float>::max())
+			throw std::runtime_error("The emitter velocity is zero");
+
+		// -> the first batch is emitted in the next step
+		cl::Buffer buffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, positions.size() * sizeof(cl_float), positions.data());
+		emitters.push_back({ emitter, buffer, (std::uint32_t) positions.size() / 3, period, period });
+	}
+
+	void Fluid::add_sink(const Fluid_Sink& sink) {
+		sinks.push_back(sink);
+		std::vector<float> boxes;
+		for(const auto& box : sinks) {
+			boxes.insert(boxes.end(), box.lower.begin(), box.lower.end());
+			boxes.insert(boxes.end(), box.upper.begin(), box.upper.end());
+		}
+		fluid_sinks_buffer = cl::Buffer(ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, boxes.size() * sizeof(cl_float), boxes.data());
+		kernel_arguments_outdated = true;
+	}
+
+	void Fluid::set_domain_culling(bool enabled) {
+		domain_culling = enabled;
+		kernel_arguments_outdated = true;
+	}
+
+	void Fluid::clear_particle_flow() {
+		emitters.clear();
+		sinks.clear();
+		fluid_sinks_buffer = cl::Buffer();
+		domain_culling = false;
+		kernel_arguments_outdated = true;
+	}
+
+	Force_Balance Fluid::measure_force_balance() {
+		Force_Balance result = { 0.0, 0.0 };
+		if(!prepare_update())
+			return result;
+
+		// |sum| / sum of || of the accumulated forces, the buffer is cleared again afterwards
+		std::vector<float> forces(params.fluid_count * 3);
+		const std::vector<float> zero_forces(forces.size(), 0.f);
+		auto measure = [&](cl::Kernel& kernel) {
+			enqueue_kernel(kernel, params.fluid_count);
+			queue.enqueueReadBuffer(fluid_pair_forces, CL_TRUE, 0, forces.size() * sizeof(cl_float), forces.data());
+			queue.enqueueWriteBuffer(fluid_pair_forces, CL_TRUE, 0, zero_forces.size() * sizeof(cl_float), zero_forces.data());
+
+			double sum[3] = { 0.0, 0.0, 0.0 };
+			double magnitude_sum = 0.0;
+			for(std::size_t i = 0; i < params.fluid_count; i++) {
+				double magnitude2 = 0.0;
+				for(int axis = 0; axis < 3; axis++) {
+					sum[axis] += forces[3 * i + axis];
+					magnitude2 += (double) forces[3 * i + axis] * forces[3 * i + axis];
+				}
+				magnitude_sum += std::sqrt(magnitude2);
+			}
+			const double net_force = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+			return magnitude_sum > 0.0 ? net_force / magnitude_sum : 0.0;
+		};
+
+		// -> the pressure forces are evaluated independently of the solver state
+		pcisph_accumulate_pressure_forces.setArg(8, nullptr);
+		result.pressure_imbalance = measure(pcisph_accumulate_pressure_forces);
+		pcisph_accumulate_pressure_forces.setArg(8, solver_state_buffer);
+		result.other_imbalance = measure(pcisph_accumulate_other_forces);
+		return result;
+	}
+
+	bool Fluid::uses_cell_tiles() const {
+		return work_distribution == Work_Distribution::PER_CELL && tile_local_size > 0;
+	}
+
+	void Fluid::set_compressed_storage(bool enabled) {
+		if(enabled && PARTICLE_LAYOUT != PARTICLE_LAYOUT_PACKED)
+			throw std::runtime_error("The compressed storage requires the packed particle layout");
+		if(enabled == compressed_storage)
+			return;
+		compressed_storage = enabled;
+		attribute_kernels_outdated = true;
+		kernel_arguments_outdated = true;
+		boundary_updated = true;
+	}
+
+	bool Fluid::is_storage_compressed() const {
+		return compressed_storage;
+	}
+
+	void Fluid::set_program_specialization(bool enabled) {
+		program_specialization = enabled;
+	}
+
+	std::size_t Fluid::get_particle_vec_size() const {
+		return compressed_storage ? 3 * sizeof(std::uint16_t) : PARTICLE_VEC_FLOATS * sizeof(cl_float);
+	}
+
+	std::size_t Fluid::get_particle_vec_offset(std::size_t count, std::size_t i, unsigned int component) const {
+		if(compressed_storage)
+			return (3 * i + component) * sizeof(std::uint16_t);
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+		return (component * count + i) * sizeof(cl_float);
+#else
+		// -> the count is the plane stride of the SoA layout only
+		(void) count;
+		return (i * PARTICLE_VEC_FLOATS + component) * sizeof(cl_float);
+#endif
+	}
+
+	std::string Fluid::get_particle_layout_name() const {
+		if(compressed_storage)
+			return "compressed";
+#if PARTICLE_LAYOUT == PARTICLE_LAYOUT_FLOAT4
+		return "float4";
+#elif PARTICLE_LAYOUT == PARTICLE_LAYOUT_SOA
+		return "soa";
+#else
+		return "packed float3";
+#endif
+	}
+
+	std::vector<std::uint8_t> Fluid::to_particle_layout(const std::vector<float>& packed, bool positions, std::size_t capacity) const {
+		const std::size_t count = packed.size() / 3;
+		capacity = std::max(capacity, count);
+		const float origin[3] = { params.position_origin_x, params.position_origin_y, params.position_origin_z };
+		std::vector<std::uint8_t> result(capacity * get_particle_vec_size(), 0);
+		for(std::size_t i = 0; i < count; i++) {
+			for(unsigned int c = 0; c < 3; c++) {
+				const float value = packed[3 * i + c];
+				auto dst = result.data() + get_particle_vec_offset(capacity, i, c);
+				if(!compressed_storage) {
+					std::memcpy(dst, &value, sizeof(float));
+					continue;
+				}
+				std::uint16_t compressed;
+				if(positions)
+					compressed = (std::uint16_t) std::min(65535.f, std::max(0.f, std::round((value - origin[c]) * params.position_scale)));
+				else
+					compressed = float_to_half(value);
+				std::memcpy(dst, &compressed, sizeof(compressed));
+			}
+		}
+		return result;
+	}
+
+	std::vector<float> Fluid::from_particle_layout(const std::vector<std::uint8_t>& data, bool positions) const {
+		const std::size_t count = data.size() / get_particle_vec_size();
+		const float origin[3] = { params.position_origin_x, params.position_origin_y, params.position_origin_z };
+		std::vector<float> result(count * 3);
+		for(std::size_t i = 0; i < count; i++) {
+			for(unsigned int c = 0; c < 3; c++) {
+				auto src = data.data() + get_particle_vec_offset(count, i, c);
+				float& value = result[3 * i + c];
+				if(!compressed_storage) {
+					std::memcpy(&value, src, sizeof(float));
+					continue;
+				}
+				std::uint16_t compressed;
+				std::memcpy(&compressed, src, sizeof(compressed));
+				value = positions ? origin[c] + compressed / params.position_scale : half_to_float(compressed);
+			}
+		}
+		return result;
+	}
+
+	void Fluid::update_position_quantization() {
+		// -> the domain is extended by a quarter of its size on every side for particles which leave the initial bounding box,
+		// positions outside are clamped
+		float extent = 0.f;
+		for(int i = 0; i < 3; i++)
+			extent = std::max(extent, domain_upper[i] - domain_lower[i]);
+		const float margin = 0.25f * extent;
+		params.position_origin_x = domain_lower[0] - margin;
+		params.position_origin_y = domain_lower[1] - margin;
+		params.position_origin_z = domain_lower[2] - margin;
+		params.position_scale = 65535.f / std::max(extent + 2.f * margin, 0.001f);
+	}
+
+	void Fluid::set_neighbor_list_skin(float skin) {
+		// -> the list size follows the search radius (the programs are rebuilt)
+		neighbor_list_skin = skin;
+		grown_neighbor_list_size = 0;
+		kernel_arguments_outdated = true;
+	}
+
+	std::uint32_t Fluid::get_neighbor_list_size() const {
+		// -> lattice neighbors (spacing 2 particle radii) within the search radius of (1 + skin) kernel radii.
+		// the kernel radius is 2 spacings (update_deduced_params), also before the parameters are deduced
+		const float kernel_radius_in_spacings = params.kernel_radius > 0.f ? params.kernel_radius / (2.f * params.particle_radius) : 2.f;
+		const float search_radius = (1.f + neighbor_list_skin) * kernel_radius_in_spacings;
+		const float lattice_neighbors = 4.f / 3.f * utils::PI * std::pow(search_radius, 3.f);
+		auto align = [](std::uint32_t size) {
+			return (size + neighbor_list_alignment - 1) / neighbor_list_alignment * neighbor_list_alignment;
+		};
+		const auto estimated_size = align(static_cast<std::uint32_t>(std::ceil(neighbor_list_margin * lattice_neighbors)) + 1);
+		return std::max(estimated_size, align(grown_neighbor_list_size));
+	}
+
+	void Fluid::handle_neighbor_list_overflow(std::uint32_t required_size) {
+		if(required_size <= get_neighbor_list_size())
+			return;
+
+		// -> the next update rebuilds the programs and reallocates the lists (the overflowed particles searched the grid)
+		grown_neighbor_list_size = static_cast<std::uint32_t>(std::ceil(neighbor_list_margin * required_size));
+		solver_statistics.neighbor_list_growths++;
+		const cl_uint no_required_size = 0;
+		queue.enqueueWriteBuffer(neighbor_list_required_size_buffer, CL_TRUE, 0, sizeof(cl_uint), &no_required_size);
+	}
+
+	void Fluid::update_deduced_params() {
 		// only following parameters are set directly:
 		// delta_t, rest_density, particle_radius, viscosity
 		// all other attibutes are deduces from those
@@ -384,11 +1979,37 @@ namespace sim {
 		params.particle_mass = params.rest_density / std::pow(1.f / (2.f * params.particle_radius), 3);
 		
 		// -> grid (bucket count needs to be a multiple of 64 to make the hash keys locally unique
-		params.bucket_count = params.fluid_count / 2;
-		params.bucket_count -= params.bucket_count % 64;
-		params.bucket_count = std::max(64U, params.bucket_count);
-
 		params.cell_size = params.kernel_radius;
+		if(params.grid_type == GRID_TYPE_DENSE) {
+			// one cell per kernel radius inside the domain
+			cl_uint resolution[3];
+			for(int i = 0; i < 3; i++) {
+				if(domain_upper[i] < domain_lower[i])
+					throw std::runtime_error("Invalid domain for the dense grid");
+				resolution[i] = static_cast<cl_uint>(std::floor((domain_upper[i] - domain_lower[i]) / params.cell_size)) + 1;
+			}
+			params.grid_origin_x = domain_lower[0];
+			params.grid_origin_y = domain_lower[1];
+			params.grid_origin_z = domain_lower[2];
+			params.grid_resolution_x = resolution[0];
+			params.grid_resolution_y = resolution[1];
+			params.grid_resolution_z = resolution[2];
+			if(params.cell_ordering == CELL_ORDERING_MORTON) {
+				// the morton code is monotonic in every coordinate -> the last cell has the largest key
+				if(std::max({ resolution[0], resolution[1], resolution[2] }) > 1024)
+					throw std::runtime_error("The dense grid with morton ordering supports at most 1024 cells per dimension");
+				params.bucket_count = morton_code(resolution[0] - 1, resolution[1] - 1, resolution[2] - 1) + 1;
+			}
+			else {
+				params.bucket_count = resolution[0] * resolution[1] * resolution[2];
+			}
+		}
+		else {
+			// -> independent of the active count (particle flow)
+			params.bucket_count = std::max(initial_fluid_count, reserved_fluid_capacity) / 2;
+			params.bucket_count -= params.bucket_count % 64;
+			params.bucket_count = std::max(64U, params.bucket_count);
+		}
 
 		// -> smoothing kernels
 		params.poly6_normalization = 315.f / (64.f * utils::PI * std::pow(params.kernel_radius, 9.f));
@@ -441,27 +2062,111 @@ namespace sim {
 			}
 			params.density_variation_scaling_factor = -1.f / (beta * (-value_sum_dot_value_sum - value_dot_value_sum));
 		}
+	}
+
+	void Fluid::allocate_grid_buffers() {
+		const std::size_t cell_offsets_size = std::max((std::size_t) 1, params.bucket_count * 2 * sizeof(cl_uint));
+		const std::size_t cell_starts_size = (params.bucket_count + 1) * sizeof(cl_uint);
+		if(params.boundary_count > 0 && (!boundary_cell_offsets() || boundary_cell_offsets.getInfo<CL_MEM_SIZE>() != cell_offsets_size))
+			boundary_cell_offsets = cl::Buffer(ctx, CL_MEM_READ_WRITE, cell_offsets_size);
+		if(!fluid_cell_offsets() || fluid_cell_offsets.getInfo<CL_MEM_SIZE>() != cell_offsets_size)
+			fluid_cell_offsets = cl::Buffer(ctx, CL_MEM_READ_WRITE, cell_offsets_size);
+		if(!fluid_cell_starts() || fluid_cell_starts.getInfo<CL_MEM_SIZE>() != cell_starts_size)
+			fluid_cell_starts = cl::Buffer(ctx, CL_MEM_READ_WRITE, cell_starts_size);
+
+		// -> the cell keys depend on the grid
+		boundary_updated = true;
+		sorted_keys_valid = false;
+	}
+
+	void Fluid::allocate_search_buffers() {
+		// -> back buffer of the pressures (a persistent attribute while the warm start is enabled)
+		if(pressure_warm_start > 0.f) {
+			const std::size_t pressures_size = std::max((std::size_t) 1, params.fluid_capacity * sizeof(cl_float));
+			if(!fluid_pressures_back() || fluid_pressures_back.getInfo<CL_MEM_SIZE>() != pressures_size)
+				fluid_pressures_back = cl::Buffer(ctx, CL_MEM_READ_WRITE, pressures_size);
+		}
+		else {
+			fluid_pressures_back = cl::Buffer();
+		}
+
+		// -> neighbor caches (neighbor lists or cell ranges)
+		if(neighbor_search != Neighbor_Search::GRID) {
+			const std::uint32_t entries = neighbor_search == Neighbor_Search::NEIGHBOR_LIST ? get_neighbor_list_size() : cell_ranges_size;
+			const std::size_t neighbor_cache_size = std::max((std::size_t) 1, params.fluid_capacity * entries * sizeof(cl_uint));
+			if(!fluid_neighbor_cache() || fluid_neighbor_cache.getInfo<CL_MEM_SIZE>() != neighbor_cache_size)
+				fluid_neighbor_cache = cl::Buffer(ctx, CL_MEM_READ_WRITE, neighbor_cache_size);
+			if(params.boundary_count == 0)
+				boundary_neighbor_cache = cl::Buffer();
+			else if(!boundary_neighbor_cache() || boundary_neighbor_cache.getInfo<CL_MEM_SIZE>() != neighbor_cache_size)
+				boundary_neighbor_cache = cl::Buffer(ctx, CL_MEM_READ_WRITE, neighbor_cache_size);
+		}
+		else {
+			fluid_neighbor_cache = cl::Buffer();
+			boundary_neighbor_cache = cl::Buffer();
+		}
+
+		// -> incremental sort buffers
+		if(sort_method == Sort_Method::INCREMENTAL) {
+			const std::size_t keys_size = std::max((std::size_t) 1, params.fluid_capacity * sizeof(cl_uint));
+			if(!fluid_stay_keys() || fluid_stay_keys.getInfo<CL_MEM_SIZE>() != keys_size) {
+				fluid_moved_flags = cl::Buffer(ctx, CL_MEM_READ_WRITE, (params.fluid_capacity + 1) * sizeof(cl_uint));
+				fluid_mover_offsets = cl::Buffer(ctx, CL_MEM_READ_WRITE, (params.fluid_capacity + 1) * sizeof(cl_uint));
+				fluid_stay_keys = cl::Buffer(ctx, CL_MEM_READ_WRITE, keys_size);
+				fluid_mover_keys = cl::Buffer(ctx, CL_MEM_READ_WRITE, keys_size);
+				fluid_mover_ids = cl::Buffer(ctx, CL_MEM_READ_WRITE, keys_size);
+			}
+		}
+		else {
+			fluid_moved_flags = cl::Buffer();
+			fluid_mover_offsets = cl::Buffer();
+			fluid_stay_keys = cl::Buffer();
+			fluid_mover_keys = cl::Buffer();
+			fluid_mover_ids = cl::Buffer();
+		}
+
+		// -> occupied cells (work-group per cell)
+		if(uses_cell_tiles()) {
+			const std::size_t cell_indices_size = (params.fluid_capacity + 1) * sizeof(cl_uint);
+			if(!fluid_occupied_cell_indices() || fluid_occupied_cell_indices.getInfo<CL_MEM_SIZE>() != cell_indices_size) {
+				fluid_occupied_cell_indices = cl::Buffer(ctx, CL_MEM_READ_WRITE, cell_indices_size);
+				fluid_occupied_cells = cl::Buffer(ctx, CL_MEM_READ_WRITE, (params.fluid_capacity + 2) * sizeof(cl_uint));
+			}
+		}
+		else {
+			fluid_occupied_cell_indices = cl::Buffer();
+			fluid_occupied_cells = cl::Buffer();
+		}
+	}
+
+	void Fluid::update_deduced_attributes() {
+		update_deduced_params();
 
 		// buffers
+		allocate_grid_buffers();
 		if(params.boundary_count > 0) {
-			boundary_cell_offsets = cl::Buffer(ctx, CL_MEM_READ_WRITE, std::max((std::size_t) 1, params.bucket_count * 2 * sizeof(cl_uint)));
 			boundary_keys = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.boundary_count * sizeof(cl_uint));
 			boundary_src_locations = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.boundary_count * sizeof(cl_uint));
-			boundary_positions_tmp = cl::Buffer(ctx, CL_MEM_READ_WRITE, 3 * params.boundary_count * sizeof(cl_float));
+			boundary_positions_tmp = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.boundary_count * get_particle_vec_size());
 			boundary_init_pred_densities = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.boundary_count * sizeof(cl_float));
 		}
 
-		fluid_cell_offsets = cl::Buffer(ctx, CL_MEM_READ_WRITE, std::max((std::size_t) 1, params.bucket_count * 2 * sizeof(cl_uint)));
-		fluid_keys = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.fluid_count * sizeof(cl_uint));
-		fluid_src_locations = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.fluid_count * sizeof(cl_uint));
-		fluid_positions_tmp = cl::Buffer(ctx, CL_MEM_READ_WRITE, 3 * params.fluid_count * sizeof(cl_float));
-		fluid_velocities_tmp = cl::Buffer(ctx, CL_MEM_READ_WRITE, 3 * params.fluid_count * sizeof(cl_float));
-		fluid_density_variations = cl::Buffer(ctx, CL_MEM_READ_WRITE, params.fluid_count * sizeof(cl_float));
+		allocate_fluid_buffers();
 
 		// initialize buffers
-		std::vector<float> zero_data(params.fluid_count * 3, 0.f);
-		queue.enqueueWriteBuffer(fluid_velocities, CL_TRUE, 0, zero_data.size() * sizeof(float), zero_data.data());
+		std::vector<std::uint8_t> zero_data(params.fluid_capacity * get_particle_vec_size(), 0);
+		queue.enqueueWriteBuffer(fluid_velocities, CL_TRUE, 0, zero_data.size(), zero_data.data());
+	}
 
-		boundary_updated = true;
+	void Fluid::allocate_fluid_buffers() {
+		fluid_keys = cl::Buffer(ctx, CL_MEM_READ_WRITE, std::max((std::size_t) 1, params.fluid_capacity * sizeof(cl_uint)));
+		fluid_src_locations = cl::Buffer(ctx, CL_MEM_READ_WRITE, std::max((std::size_t) 1, params.fluid_capacity * sizeof(cl_uint)));
+		fluid_density_variations = cl::Buffer(ctx, CL_MEM_READ_WRITE, std::max((std::size_t) 1, params.fluid_capacity * sizeof(cl_float)));
+		fluid_pair_forces = cl::Buffer(ctx, CL_MEM_READ_WRITE, std::max((std::size_t) 1, params.fluid_capacity * 3 * sizeof(cl_float)));
+		std::vector<float> zero_pair_forces(params.fluid_capacity * 3, 0.f);
+		if(!zero_pair_forces.empty())
+			queue.enqueueWriteBuffer(fluid_pair_forces, CL_TRUE, 0, zero_pair_forces.size() * sizeof(cl_float), zero_pair_forces.data());
+
+		allocate_attribute_buffers();
 	}
 }
\ No newline at end of file
@@ -1,25 +1,185 @@
 #pragma once
 
 #include <data/kernels/Simulation_Params.h>
+#include "local_size_tuning.h"
 
-#include <gl_libs.h>
+#include <cl_libs.h>
 #include <memory>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <utility>
+#include <future>
+#include <map>
 
 namespace clogs {
 	class Radixsort;
+	class Scan;
 }
 
 namespace sim {
+	// statistics of the last PCISPH pressure solve
+	struct Solver_Statistics {
+		unsigned int iterations;
+		// both relative to the rest density
+		float max_density_variation;
+		float mean_density_variation;
+		// PCISPH kernel launches (without sorting) of the last update / advance
+		unsigned int kernel_launches;
+		// neighbor lists grown after an overflow since the fluid was created (the overflowed particles searched the grid)
+		unsigned int neighbor_list_growths;
+		// the work-group per cell distribution is set but not supported by the device (one work-item per particle is used)
+		bool cell_tiles_unsupported;
+	};
+
+	enum class Kernel_Fusion {
+		// separate prediction kernel in every PCISPH iteration
+		NONE = KERNEL_FUSION_NONE,
+		// the force initialization / pressure force kernels predict the positions of the following iteration
+		PREDICT_WITH_FORCES = KERNEL_FUSION_PREDICT_WITH_FORCES,
+		// the pressure kernels predict all positions on the fly from the velocities and forces (no predicted positions buffer traffic,
+		// but four instead of one particle vector per neighbor)
+		PREDICT_ON_THE_FLY = KERNEL_FUSION_PREDICT_ON_THE_FLY
+	};
+
+	// work distribution of update_density, update_pressure (fluid) and update_pressure_force
+	enum class Work_Distribution {
+		// one work-item per particle, every work-item loads its neighbors from global memory
+		PER_PARTICLE,
+		// one work-group per occupied cell, the neighborhood of the cell is loaded once into local memory and shared 
+		// by all particles of the cell (always searches the grid). falls back to PER_PARTICLE if the device doesn't 
+		// support a work-group size of at least 32 for the tiled kernels
+		PER_CELL
+	};
+
+	// evaluation of the fluid-fluid forces (viscosity, surface tension and pressure)
+	enum class Pair_Evaluation {
+		// every particle evaluates all of its neighbors, every pair is computed twice
+		FULL,
+		// every pair is computed once (half shell of the neighbor cells) and the opposite force is added to the partner 
+		// with float atomics. conserves momentum exactly, the viscosity uses the mean density of the pair
+		SYMMETRIC
+	};
+
+	// momentum balance of the fluid-fluid forces (see Fluid::measure_force_balance):
+	// |sum of the forces| / sum of |force| over all fluid particles, 0 for exact conservation (up to float rounding)
+	struct Force_Balance {
+		double pressure_imbalance;
+		double other_imbalance;
+	};
+
+	// device time of a kernel function (see Fluid::set_kernel_profiling)
+	struct Kernel_Profile {
+		double time_ms;
+		std::uint32_t launches;
+		std::uint32_t local_size;
+	};
+
+	// additional per fluid particle data (see Fluid::add_attribute)
+	enum class Attribute_Type {
+		FLOAT,
+		INT,
+		UINT
+	};
+
+	struct Particle_Attribute {
+		// has to be a valid OpenCL identifier
+		std::string name;
+		Attribute_Type type;
+		// components per particle (float attributes with 3 components use the particle vector layout)
+		unsigned int width;
+		// persistent attributes keep their values across steps and are reordered with the particles,
+		// all others have to be recalculated in every step
+		bool persistent;
+	};
+
+	// number of fluid sorts per path (incremental sort method)
+	struct Sort_Statistics {
+		unsigned int full_sorts;
+		unsigned int incremental_sorts;
+		// particles which changed their cell in the incrementally sorted steps
+		unsigned long long moved_particles;
+	};
+
+	enum class Neighbor_Search {
+		// searches the 27 neighboring grid cells in every kernel
+		GRID = NEIGHBOR_SEARCH_GRID,
+		// builds a neighbor list per fluid particle once per step which is used by all kernels
+		NEIGHBOR_LIST = NEIGHBOR_SEARCH_NEIGHBOR_LIST,
+		// caches the (start, end) offsets of the 27 neighboring cells per fluid particle once per step
+		CELL_RANGES = NEIGHBOR_SEARCH_CELL_RANGES
+	};
+
+	enum class Grid_Type {
+		// spatial hash with fluid_count / 2 buckets (the reserved capacity if larger, unbounded domain)
+		HASHED = GRID_TYPE_HASHED,
+		// linearly indexed cells covering the domain (see Fluid::set_domain), particles outside are clamped to the border cells
+		DENSE = GRID_TYPE_DENSE
+	};
+
+	enum class Cell_Ordering {
+		// hash (hashed grid) or x-y-z order (dense grid)
+		LINEAR = CELL_ORDERING_LINEAR,
+		// z-order curve, spatially close cells are close in memory
+		MORTON = CELL_ORDERING_MORTON
+	};
+
+	enum class Sort_Method {
+		// radix sort of the cell keys (clogs)
+		RADIX,
+		// histogram of the cell keys + exclusive scan (clogs) + scatter, O(n) and no key bit count dependency
+		COUNTING,
+		// only sorts the particles which changed their cell since the last step and merges them with the others.
+		// the device falls back to a counting sort of the keys if too many particles moved (select_sort_path, no host read)
+		INCREMENTAL
+	};
+
+	// particle source (see Fluid::add_emitter): the box is filled with a lattice of particles (one particle diameter apart)
+	// which is emitted with the velocity, the next batch follows once the previous one has left the box
+	struct Fluid_Emitter {
+		std::array<float, 3> lower;
+		std::array<float, 3> upper;
+		std::array<float, 3> velocity;
+	};
+
+	// the fluid particles inside of the box are removed
+	struct Fluid_Sink {
+		std::array<float, 3> lower;
+		std::array<float, 3> upper;
+	};
+
 	class Fluid {
 	public:
+		// (radixsort, scan) created on a worker thread
+		typedef std::shared_future<std::pair<std::shared_ptr<clogs::Radixsort>, std::shared_ptr<clogs::Scan>>> Pending_Sort_Primitives;
+
 		Fluid(cl::Context ctx, cl::Device device, cl::CommandQueue queue);
 		void checkBuffersConsistent() const;
 		void update();
+		// builds the programs and buffers for the current settings ahead of the first step (done by update / advance otherwise)
+		void prepare();
+		// enqueues step_count complete time steps without any host synchronization in between.
+		// the PCISPH convergence is checked on the device, the iterations per step are available afterwards
+		void advance(unsigned int step_count);
 		const Simulation_Params& get_params() const;
+		const Solver_Statistics& get_solver_statistics() const;
+		const std::vector<unsigned int>& get_step_iterations() const;
+		const Sort_Statistics& get_sort_statistics() const;
+		// OpenCL build options of the simulation programs (for programs which include the kernel headers).
+		// they depend on the scene if the programs are specialized and are only valid after the first update
+		const std::string& get_build_params() const;
+		// the particles are sorted from the front into the back buffers which are swapped afterwards.
+		// returns true if fluid_positions / fluid_velocities currently refer to the buffers created as back buffers
+		bool are_particle_buffers_swapped() const;
 
-		// parameters setter
+		// parameters setter. they can be changed between updates: the physical constants (delta_t, rest density, gravity, viscosity,
+		// surface tension) only update the parameter buffer, the particle radius and the grid settings resize the cell buffers and
+		// the particle counts reallocate all particle buffers and reset the velocities
 		void set_boundary_count(unsigned int boundary_count);
 		void set_fluid_count(unsigned int fluid_count);
+		// particles the fluid buffers are allocated for (at least the fluid count), the buffers are sized by get_params().fluid_capacity
+		void set_fluid_capacity(unsigned int capacity);
 		void set_delta_t(float delta_t);
 		void set_rest_density(float rest_density);
 		void set_particle_radius(float particle_radius);
@@ -27,6 +187,83 @@ namespace sim {
 		void set_viscosity(float viscosity);
 		void set_surface_tension(float surface_tension_coefficient);
 		void set_density_variation_threshold(float density_variation_threshold);
+		// checks the convergence of iteration i while iteration i + 1 is already running (costs at most one extra iteration)
+		void set_pipelined_convergence_check(bool enabled);
+		// the pressure solve of a step starts from the pressures of the previous step scaled by factor (0: from zero pressure).
+		// the pressures are reordered with the particles and their pressure force is evaluated before the first iteration.
+		// emitted particles start at zero pressure, so does the first step after the buffers or the boundary changed
+		void set_pressure_warm_start(float factor);
+		void set_neighbor_search(Neighbor_Search neighbor_search);
+		void set_grid_type(Grid_Type grid_type);
+		// order of the cells (and therefore of the sorted particles)
+		void set_cell_ordering(Cell_Ordering cell_ordering);
+		// sorting of the fluid particles (the boundary is always sorted with the radix sort)
+		void set_sort_method(Sort_Method sort_method);
+		// fraction of moved particles up to which the incremental sort is used
+		void set_incremental_sort_threshold(float threshold);
+		// bounding box of the simulation (only used by the dense grid)
+		void set_domain(const std::array<float, 3>& lower, const std::array<float, 3>& upper);
+		// additional search radius of the neighbor lists (relative to the kernel radius) to cover the predicted positions
+		void set_neighbor_list_skin(float skin);
+		// uints per neighbor list (count + neighbor ids): the lattice neighbors within the search radius with a margin, grown
+		// (programs rebuilt) after a list overflowed. the particles of an overflowed list search the grid until then
+		std::uint32_t get_neighbor_list_size() const;
+		void set_kernel_fusion(Kernel_Fusion kernel_fusion);
+		void set_work_distribution(Work_Distribution work_distribution);
+		void set_pair_evaluation(Pair_Evaluation pair_evaluation);
+		// PER_CELL and supported by the device
+		bool uses_cell_tiles() const;
+		// stores the positions as 16 bit fixed point values inside the domain (see set_domain) and all other particle vectors as half.
+		// only supported by the packed layout, has to be set before the particle buffers are created
+		void set_compressed_storage(bool enabled);
+		bool is_storage_compressed() const;
+		// compiles the programs for the current scene: unused features (boundary, gravity, viscosity, surface tension) are removed
+		// and the fixed parameters are constant-folded. the programs are rebuilt (or taken from the cache) if one of those changes
+		void set_program_specialization(bool enabled);
+		bool is_program_specialized() const;
+		// starts compiling the programs for the current settings and parameters on worker threads, e.g. while the scene is generated.
+		// the first update waits for them (and starts them itself if the build options changed in between)
+		void start_program_builds();
+		// particle flow: the active fluid particles are kept at the front of the fluid buffers. emitters append particles before the
+		// sort of a step, sinks and the domain culling remove them during the sort (the removed particles are sorted behind the active
+		// ones). the active count is kept on the device, get_params().fluid_count is updated once per update / advance
+		bool uses_particle_flow() const;
+		// reallocates the fluid buffers if the emitters exceed the capacity (at least doubles it), the surplus particles are dropped
+		// otherwise. has to be disabled if the fluid buffers are shared with gl
+		void set_capacity_growth(bool enabled);
+		// the lattice depends on the particle radius. the attributes (see add_attribute) of emitted particles are undefined
+		void add_emitter(const Fluid_Emitter& emitter);
+		void add_sink(const Fluid_Sink& sink);
+		// removes the particles outside of the range of the compressed positions (the domain extended by a quarter on every side)
+		void set_domain_culling(bool enabled);
+		// removes all emitters and sinks and disables the domain culling
+		void clear_particle_flow();
+		// evaluates the fluid-fluid forces of the current state with the current pair evaluation (blocking)
+		Force_Balance measure_force_balance();
+		// work-group size per kernel function (the constructor loads the tuning database of the device), kernels without an entry use
+		// the default size. the sizes are limited by the kernels (CL_KERNEL_WORK_GROUP_SIZE). the reduction and the work-group per
+		// cell kernels have fixed sizes
+		void set_local_sizes(const Local_Sizes& local_sizes);
+		void set_default_local_size(std::uint32_t local_size);
+		// records the device time of every launch of the tunable kernels (the queue needs CL_QUEUE_PROFILING_ENABLE)
+		void set_kernel_profiling(bool enabled);
+		// profile per kernel function since the last call (waits for the recorded launches)
+		std::map<std::string, Kernel_Profile> get_kernel_profile();
+
+		// particle vectors (positions, velocities, forces, normals) are stored in the compile time layout PARTICLE_LAYOUT
+		// (Simulation_Params.h) or compressed. bytes per particle and byte offset of a component of particle i
+		std::size_t get_particle_vec_size() const;
+		std::size_t get_particle_vec_offset(std::size_t count, std::size_t i, unsigned int component) const;
+		std::string get_particle_layout_name() const;
+		// conversion between packed float3 host data and the particle vector buffers (positions are quantized if compressed).
+		// the result holds at least capacity particles (SoA plane size), the remaining ones are zero
+		std::vector<std::uint8_t> to_particle_layout(const std::vector<float>& packed, bool positions, std::size_t capacity = 0) const;
+		std::vector<float> from_particle_layout(const std::vector<std::uint8_t>& data, bool positions) const;
+
+		// registers an additional attribute, the buffers are allocated by the fluid (returns the attribute id)
+		unsigned int add_attribute(const Particle_Attribute& attribute);
+		// buffer which currently holds the attribute values
+		cl::Buffer& get_attribute_buffer(unsigned int id);
 
 		// opencl objects
 		cl::Context ctx;
@@ -35,8 +272,9 @@ namespace sim {
 		
 		// particle state
 		//	NOTE: 
-		//	If additional attributes are added which are not completely recalculated every frame you have to reorder them
-		//	in every update stept. To do this add them in the function Fluid::reorder_particles and the corresponding kernel
+		//	Attributes which are not completely recalculated every frame have to be reordered in every update step.
+		//	Positions and velocities are reordered by default, other attributes can be registered with Fluid::add_attribute.
+		//	fluid_positions / fluid_velocities are the front buffers, they are swapped with the back buffers in every step
 		cl::Buffer boundary_positions;
 		cl::Buffer boundary_pressures;
 
@@ -46,45 +284,208 @@ namespace sim {
 		cl::Buffer fluid_densities;
 		cl::Buffer fluid_other_forces;
 		cl::Buffer fluid_velocities;
+		cl::Buffer fluid_positions_back;
+		cl::Buffer fluid_velocities_back;
 		cl::Buffer fluid_pressures;
 		cl::Buffer fluid_pressure_forces;
 		
 	private:
+		// what a parameter change invalidates, every level includes the ones before it
+		enum class Param_Change {
+			NONE,
+			// values of the parameter buffer (physical constants, time step, solver settings)
+			CONSTANTS,
+			// cell size and cell count: the cell buffers are resized if needed and the boundary is sorted again
+			GRID,
+			// particle counts: all particle buffers are (re)allocated and the velocities are reset
+			BUFFERS
+		};
+
+		bool prepare_update();
+		std::vector<cl_mem> get_buffer_handles() const;
+		// all kernel arguments are bound once and only rebound if a buffer changes
+		void bind_kernel_arguments();
+		// arguments which refer to the front / back buffers
+		void bind_particle_state_arguments();
+		void swap_particle_buffers();
+		void enqueue_particle_emission();
+		void enqueue_sort_particles();
+		// adds the device counters of the incremental sort (read into sort_state) to the sort statistics
+		void update_sort_statistics();
+		// copies the active count of fluid_count_buffer into the parameter buffer
+		void enqueue_fluid_count_update();
+		// blocking, updates the host count and its bound
+		void read_fluid_count();
+		void grow_fluid_capacity(std::uint32_t capacity);
+		void enqueue_force_initialization();
+		// pressure force of the warm-started pressures (after the reset of the solver state)
+		void enqueue_pressure_warm_start();
+		void enqueue_pressure_update();
+		void enqueue_pressure_force_update();
+		void enqueue_time_integration();
+		void enqueue_density_variation_reduction();
+		// grows the neighbor lists to required_size (largest overflowed list, 0 if none)
+		void handle_neighbor_list_overflow(std::uint32_t required_size);
+		// enqueues a kernel over count particles and counts the launch (Solver_Statistics::kernel_launches)
+		void enqueue_pcisph_kernel(cl::Kernel& kernel, std::uint32_t count);
+		// enqueues a kernel over count items with its (tuned) local size
+		void enqueue_kernel(cl::Kernel& kernel, std::uint32_t count);
+		void collect_kernel_profile();
+		// enqueues a work-group per cell kernel (Work_Distribution::PER_CELL)
+		void enqueue_tiled_kernel(cl::Kernel& kernel);
+		void invalidate_params(Param_Change change);
+		// a physical constant changed after the programs were built (see STEERED_PARAMS in grid_utils.cl)
+		void steer_physical_param(float& param, float value);
+		// parameters deduced from the set ones (update_deduced_attributes also (re)allocates the buffers)
+		void update_deduced_params();
 		void update_deduced_attributes();
-		void sort_particles_cpu(cl::Buffer& src_locations, cl::Buffer cell_offsets);
-		void reorder_particles(cl::Buffer& src_locations);
+		void allocate_grid_buffers();
+		// buffers per fluid particle owned by the fluid (sized by the capacity)
+		void allocate_fluid_buffers();
+		// neighbor caches, incremental sort, occupied cell and warm-start pressure buffers (only allocated if used)
+		void allocate_search_buffers();
+		void update_position_quantization();
+		void build_programs();
+		std::string get_required_build_params() const;
+		// registered attributes
+		void allocate_attribute_buffers();
+		void build_attribute_kernels();
+		std::vector<Particle_Attribute> get_persistent_attributes() const;
+		// (front, back) of all persistent attributes (including positions and velocities)
+		std::vector<std::pair<cl::Buffer*, cl::Buffer*>> get_persistent_buffers();
 		
 		// settings
-		bool params_changed;
+		Param_Change params_changed;
 		bool boundary_updated;
 		float density_variation_threshold;
+		bool pipelined_convergence_check;
+		float pressure_warm_start;
+		// the pressures (fluid and boundary) belong to the current particle order
+		bool warm_pressures_valid;
+		bool kernel_arguments_outdated;
+		Neighbor_Search neighbor_search;
+		Sort_Method sort_method;
+		float incremental_sort_threshold;
+		// the fluid keys are sorted and belong to the current particle order
+		bool sorted_keys_valid;
+		bool particle_buffers_swapped;
+		Sort_Statistics sort_statistics;
+		// host copy of fluid_sort_state and the counters of its last read (the device counters wrap around)
+		cl_uint sort_state[4];
+		cl_uint read_sort_counters[3];
+		float neighbor_list_skin;
+		// list size needed by the largest overflowed list so far (0 if none overflowed)
+		std::uint32_t grown_neighbor_list_size;
+		bool compressed_storage;
+		Work_Distribution work_distribution;
+		Pair_Evaluation pair_evaluation;
+		bool program_specialization;
+		// the physical constants are read from the parameter buffer by the specialized programs
+		bool steered_params;
+		// local size of the tiled kernels (0 if not supported) and number of work-groups (they loop over the occupied cells)
+		std::uint32_t tile_local_size;
+		std::uint32_t tile_group_count;
+		Local_Sizes local_sizes;
+		std::uint32_t default_local_size;
+		// (function name, local size) of the kernel objects, resolved on their first launch
+		std::map<cl_kernel, std::pair<std::string, std::uint32_t>> kernel_launch_configs;
+		bool kernel_profiling;
+		std::vector<std::pair<std::string, cl::Event>> profiled_launches;
+		std::map<std::string, Kernel_Profile> kernel_profile;
+		std::array<float, 3> domain_lower;
+		std::array<float, 3> domain_upper;
+		// particle flow
+		struct Emitter_State {
+			Fluid_Emitter emitter;
+			// packed float3 positions of a batch
+			cl::Buffer positions;
+			std::uint32_t count;
+			// time between two batches and since the last one
+			float period;
+			float time;
+		};
+		std::vector<Emitter_State> emitters;
+		std::vector<Fluid_Sink> sinks;
+		bool domain_culling;
+		bool capacity_growth;
+		unsigned int initial_fluid_count;
+		unsigned int reserved_fluid_capacity;
+		// upper bound of the active count on the device (launch size of the fluid kernels), exact after every update / advance
+		std::uint32_t max_fluid_count;
 		Simulation_Params params;
+		std::string build_params;
+		// build options and programs of the last start_program_builds
+		std::string pending_build_params;
+		std::shared_future<cl::Program> pending_sort_utils_prog;
+		std::shared_future<cl::Program> pending_reduce_utils_prog;
+		std::shared_future<cl::Program> pending_pcisph_prog;
+		Pending_Sort_Primitives pending_sort_primitives;
+		Solver_Statistics solver_statistics;
+		std::vector<unsigned int> step_iterations;
+		std::vector<cl_mem> bound_buffer_handles;
 
 		// programs / kernels
-		cl::Program cpu_sort_helper_prog;
-		cl::Kernel cpu_sort_helper_calculate_hash_keys_kernel;
-		cl::Kernel cpu_sort_helper_reorder_particles_kernel;
-
-		cl::Program radix_prog;
-		cl::Kernel radix_local_sort_kernel;
-
 		cl::Program sort_utils_prog;
-		cl::Kernel sort_utils_reset_cell_offsets;
-		cl::Kernel sort_utils_initialize;
+		cl::Kernel sort_utils_reset_boundary_cell_offsets;
+		cl::Kernel sort_utils_reset_fluid_cell_offsets;
+		cl::Kernel sort_utils_initialize_boundary;
+		cl::Kernel sort_utils_initialize_fluid;
 		cl::Kernel sort_utils_reorder_and_insert_boundary_offsets;
-		cl::Kernel sort_utils_reorder_and_insert_fluid_offsets;
+		cl::Kernel sort_utils_build_fluid_neighbor_lists;
+		cl::Kernel sort_utils_build_boundary_neighbor_lists;
+		cl::Kernel sort_utils_build_fluid_cell_ranges;
+		cl::Kernel sort_utils_build_boundary_cell_ranges;
+		cl::Kernel sort_utils_reset_fluid_cell_counts;
+		cl::Kernel sort_utils_count_fluid_particles_per_cell;
+		cl::Kernel sort_utils_insert_counted_fluid_cell_offsets;
+		cl::Kernel sort_utils_flag_moved_particles;
+		cl::Kernel sort_utils_gather_moved_particles;
+		cl::Kernel sort_utils_merge_moved_particles;
+		cl::Kernel sort_utils_select_sort_path;
+		cl::Kernel sort_utils_reset_fallback_cell_counts;
+		cl::Kernel sort_utils_flag_occupied_cells;
+		cl::Kernel sort_utils_compact_occupied_cells;
+		cl::Kernel sort_utils_update_sorted_fluid_count;
+
+		// -> generated from the registered attributes
+		cl::Program attribute_prog;
+		cl::Kernel attribute_gather_fluid;
+		cl::Kernel attribute_scatter_fluid;
+		bool attribute_kernels_outdated;
+
+		cl::Program reduce_utils_prog;
+		cl::Kernel reduce_utils_max_and_sum;
+		cl::Kernel reduce_utils_max_and_sum_partials;
 
 		cl::Program pcisph_prog;
 		cl::Kernel pcisph_update_density;
 		cl::Kernel pcisph_update_normal;
 		cl::Kernel pcisph_boundary_pressure_initialization;
 		cl::Kernel pcisph_force_initialization;
+		cl::Kernel pcisph_predict_positions;
 		cl::Kernel pcisph_update_position_and_velocity;
 		cl::Kernel pcisph_initialize_boundary_boundary_pred_densities;
-		cl::Kernel pcisph_update_pressure;
+		cl::Kernel pcisph_update_boundary_pressure;
+		cl::Kernel pcisph_update_fluid_pressure;
 		cl::Kernel pcisph_update_pressure_force;
+		cl::Kernel pcisph_update_density_tiled;
+		cl::Kernel pcisph_update_fluid_pressure_tiled;
+		cl::Kernel pcisph_update_pressure_force_tiled;
+		cl::Kernel pcisph_accumulate_other_forces;
+		cl::Kernel pcisph_accumulate_pressure_forces;
+		cl::Kernel pcisph_reset_solver_state;
+		cl::Kernel pcisph_update_solver_state;
+		cl::Kernel pcisph_emit_particles;
 
 		// internal buffers
+		cl::Buffer params_buffer;
+		// active fluid count, written by the emission and the sort
+		cl::Buffer fluid_count_buffer;
+		// 6 floats (lower, upper) per sink
+		cl::Buffer fluid_sinks_buffer;
+		// largest list size needed by an overflowed neighbor list (0 if none), reset after growing
+		cl::Buffer neighbor_list_required_size_buffer;
+
 		cl::Buffer boundary_cell_offsets;
 		cl::Buffer boundary_keys;
 		cl::Buffer boundary_src_locations;
@@ -94,10 +495,38 @@ namespace sim {
 		cl::Buffer fluid_cell_offsets;
 		cl::Buffer fluid_keys;
 		cl::Buffer fluid_src_locations;
-		cl::Buffer fluid_positions_tmp;
-		cl::Buffer fluid_velocities_tmp;
 		cl::Buffer fluid_density_variations;
+		cl::Buffer fluid_cell_starts;
+		cl::Buffer fluid_moved_flags;
+		cl::Buffer fluid_mover_offsets;
+		cl::Buffer fluid_stay_keys;
+		cl::Buffer fluid_mover_keys;
+		cl::Buffer fluid_mover_ids;
+		// path of the incremental sort and its counters (see select_sort_path)
+		cl::Buffer fluid_sort_state;
+		cl::Buffer fluid_occupied_cell_indices;
+		cl::Buffer fluid_occupied_cells;
+		// 3 floats per fluid particle (symmetric pair evaluation), zero between the evaluations
+		cl::Buffer fluid_pair_forces;
+		// back buffer of the pressures (only reordered with the warm start)
+		cl::Buffer fluid_pressures_back;
+		cl::Buffer fluid_neighbor_cache;
+		cl::Buffer boundary_neighbor_cache;
+		cl::Buffer fluid_density_variation_result;
+		cl::Buffer reduce_partial_results;
+		cl::Buffer solver_state_buffer;
+		cl::Buffer step_iterations_buffer;
+
+		// registered attributes
+		struct Attribute_Buffers {
+			Particle_Attribute attribute;
+			cl::Buffer front;
+			cl::Buffer back;
+		};
+		std::vector<Attribute_Buffers> attributes;
+
 		// 
 		std::shared_ptr<clogs::Radixsort> radixsort;
+		std::shared_ptr<clogs::Scan> scan;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "local_size_tuning.h"
+#include "program_cache.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <tuple>
+#include <stdexcept>
+
+namespace sim {
+	namespace {
+		typedef std::tuple<std::string, std::string, std::uint32_t> Database_Entry;
+
+		// the device key contains spaces, the fields are separated by tabs
+		std::vector<Database_Entry> read_database(const std::string& path) {
+			std::vector<Database_Entry> entries;
+			std::ifstream file(path);
+			std::string line;
+			while(std::getline(file, line)) {
+				std::istringstream fields(line);
+				std::string device_key, kernel, local_size;
+				if(!std::getline(fields, device_key, '\t') || !std::getline(fields, kernel, '\t') || !std::getline(fields, local_size))
+					continue;
+				try {
+					entries.emplace_back(device_key, kernel, static_cast<std::uint32_t>(std::stoul(local_size)));
+				}
+				catch(std::exception&) {
+				}
+			}
+			return entries;
+		}
+	}
+
+	Local_Sizes load_local_sizes(cl::Device device, const std::string& path) {
+		const auto device_key = get_device_key(device);
+		Local_Sizes result;
+		for(const auto& entry : read_database(path)) {
+			if(std::get<0>(entry) == device_key && std::get<2>(entry) > 0)
+				result[std::get<1>(entry)] = std::get<2>(entry);
+		}
+		return result;
+	}
+
+	void store_local_sizes(cl::Device device, const Local_Sizes& local_sizes, const std::string& path) {
+		const auto device_key = get_device_key(device);
+		auto entries = read_database(path);
+		std::ofstream file(path, std::ios::trunc);
+		if(!file)
+			throw std::runtime_error("Couldn't write the tuning database " + path);
+		for(const auto& entry : entries) {
+			if(std::get<0>(entry) != device_key || !local_sizes.count(std::get<1>(entry)))
+				file << std::get<0>(entry) << '\t' << std::get<1>(entry) << '\t' << std::get<2>(entry) << '\n';
+		}
+		for(const auto& local_size : local_sizes)
+			file << device_key << '\t' << local_size.first << '\t' << local_size.second << '\n';
+	}
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cl_libs.h>
+#include <map>
+#include <string>
+#include <cstdint>
+
+namespace sim {
+	// work-group size per kernel function, measured by the tuner (pcisph_headless -tune)
+	typedef std::map<std::string, std::uint32_t> Local_Sizes;
+
+	// tuning database (relative to the working directory), one line per device and kernel: <device key>\t<kernel>\t<local size>
+	const char* const local_size_database_path = "local_sizes.txt";
+
+	// stored sizes of the device (empty if the device wasn't tuned)
+	Local_Sizes load_local_sizes(cl::Device device, const std::string& path);
+	// replaces the stored sizes of the kernels in local_sizes, the other devices and kernels are kept
+	void store_local_sizes(cl::Device device, const Local_Sizes& local_sizes, const std::string& path);
+}
\ No newline at end of file
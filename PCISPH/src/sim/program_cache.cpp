@@ -0,0 +1,254 @@
+#include "program_cache.h"
+
+#include <utils/file_io.h>
+
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+
+namespace sim {
+#if defined(EMBEDDED_KERNELS)
+	struct Embedded_Kernel {
+		const char* path;
+		// the source is split into several literals (length limit of string literals), terminated by nullptr
+		const char* const* parts;
+	};
+	#include "embedded_kernels.h"
+#endif
+
+	namespace {
+		std::string program_cache_directory = "program_cache";
+		Program_Cache_Statistics statistics = { 0, 0, 0.0, 0.0 };
+		// programs being built by this process: (context, device, cache key). completed builds are removed on the next request,
+		// later requests load the binary from the disk cache (failed builds are retried). the map keeps the last reference of a
+		// pending build, the worker never releases its own state
+		std::map<std::tuple<cl_context, cl_device_id, std::string>, std::shared_future<cl::Program>> built_programs;
+		// guards the members above, the builds themselves run concurrently
+		std::mutex cache_mutex;
+
+		// FNV-1a
+		std::uint64_t hash_string(const std::string& value) {
+			std::uint64_t hash = 14695981039346656037ULL;
+			for(unsigned char c : value) {
+				hash ^= c;
+				hash *= 1099511628211ULL;
+			}
+			return hash;
+		}
+
+		std::string to_hex(std::uint64_t value) {
+			std::ostringstream result;
+			result << std::hex << std::setw(16) << std::setfill('0') << value;
+			return result.str();
+		}
+
+		std::string read_kernel_file(const std::string& path) {
+#if defined(EMBEDDED_KERNELS)
+			for(const auto& kernel : embedded_kernels) {
+				if(path != kernel.path)
+					continue;
+				std::string source;
+				for(auto part = kernel.parts; *part != nullptr; part++)
+					source += *part;
+				return source;
+			}
+			throw std::runtime_error("The kernel source " + path + " is not embedded");
+#else
+			std::vector<unsigned char> data;
+			if(!utils::read_binary_file(path, data))
+				throw std::runtime_error("Couldn't read the kernel source " + path);
+			return std::string(data.begin(), data.end());
+#endif
+		}
+
+		void append_kernel_source(const std::string& path, std::set<std::string>& included, std::string& result);
+
+		// the includes of data/kernels are replaced by the files, every file is included once (all kernel headers have include guards)
+		void append_source_lines(const std::string& source, std::set<std::string>& included, std::string& result) {
+			const std::string include_prefix = "#include <data/kernels/";
+			std::istringstream lines(source);
+			std::string line;
+			while(std::getline(lines, line)) {
+				if(!line.empty() && line.back() == '\r')
+					line.pop_back();
+				// -> the other includes belong to the host part of the headers
+				if(line.compare(0, include_prefix.size(), include_prefix) == 0 && line.back() == '>') {
+					const auto begin = std::strlen("#include <");
+					append_kernel_source(line.substr(begin, line.size() - begin - 1), included, result);
+					continue;
+				}
+				result += line;
+				result += '\n';
+			}
+		}
+
+		void append_kernel_source(const std::string& path, std::set<std::string>& included, std::string& result) {
+			if(included.insert(path).second)
+				append_source_lines(read_kernel_file(path), included, result);
+		}
+
+		// the binary of the device (a program holds one binary per device of its context)
+		std::vector<unsigned char> get_program_binary(const cl::Program& program, cl::Device device) {
+			auto devices = program.getInfo<CL_PROGRAM_DEVICES>();
+			std::vector<std::size_t> sizes(devices.size());
+			if(clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizes.size() * sizeof(std::size_t), sizes.data(), nullptr) != CL_SUCCESS)
+				return {};
+
+			std::vector<std::vector<unsigned char>> binaries(devices.size());
+			std::vector<unsigned char*> binary_pointers(devices.size());
+			for(std::size_t i = 0; i < devices.size(); i++) {
+				binaries[i].resize(sizes[i]);
+				binary_pointers[i] = binaries[i].data();
+			}
+			if(clGetProgramInfo(program(), CL_PROGRAM_BINARIES, binary_pointers.size() * sizeof(unsigned char*), binary_pointers.data(), nullptr) != CL_SUCCESS)
+				return {};
+
+			for(std::size_t i = 0; i < devices.size(); i++) {
+				if(devices[i] == device())
+					return binaries[i];
+			}
+			return {};
+		}
+
+		// cache file: key length (uint32), key, binary. the key is compared on load to detect hash collisions
+		bool load_program_binary(const std::string& path, const std::string& key, std::vector<unsigned char>& binary) {
+			std::vector<unsigned char> data;
+			if(!utils::read_binary_file(path, data) || data.size() < sizeof(std::uint32_t))
+				return false;
+			std::uint32_t key_size;
+			std::memcpy(&key_size, data.data(), sizeof(key_size));
+			if(data.size() <= sizeof(key_size) + key_size || std::string(data.begin() + sizeof(key_size), data.begin() + sizeof(key_size) + key_size) != key)
+				return false;
+			binary.assign(data.begin() + sizeof(key_size) + key_size, data.end());
+			return true;
+		}
+
+		void store_program_binary(const std::string& directory, const std::string& path, const std::string& key, const std::vector<unsigned char>& binary) {
+			if(binary.empty() || !utils::create_directory(directory))
+				return;
+			const auto key_size = static_cast<std::uint32_t>(key.size());
+			std::vector<unsigned char> data(sizeof(key_size));
+			std::memcpy(data.data(), &key_size, sizeof(key_size));
+			data.insert(data.end(), key.begin(), key.end());
+			data.insert(data.end(), binary.begin(), binary.end());
+
+			// -> written to a temporary file first, other processes never read a partial binary
+			const auto temporary_path = path + ".tmp";
+			if(!utils::write_binary_file(temporary_path, data))
+				return;
+			std::remove(path.c_str());
+			if(std::rename(temporary_path.c_str(), path.c_str()) != 0)
+				std::remove(temporary_path.c_str());
+		}
+
+		// runs on a worker thread. a program which fails to build is returned unbuilt (the caller reports the build log)
+		cl::Program build_program(cl::Context ctx, cl::Device device, std::string source, std::string build_params, std::string key, std::string directory) {
+			const auto start = std::chrono::steady_clock::now();
+			auto add_time = [&](unsigned int& programs, double& ms) {
+				std::lock_guard<std::mutex> lock(cache_mutex);
+				programs++;
+				ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			};
+
+			// -> binary of an earlier run (rebuilt from source if the driver rejects it)
+			const auto cache_path = directory + "/" + to_hex(hash_string(key)) + ".bin";
+			std::vector<unsigned char> binary;
+			if(!directory.empty() && load_program_binary(cache_path, key, binary)) {
+				try {
+					std::vector<cl_int> binary_status(1);
+					cl::Program program(ctx, { device }, { std::make_pair(binary.data(), binary.size()) }, &binary_status);
+					program.build({ device }, build_params.c_str());
+					add_time(statistics.loaded_programs, statistics.load_ms);
+					return program;
+				}
+				catch(cl::Error&) {
+				}
+			}
+
+			cl::Program program(ctx, { std::make_pair(source.c_str(), source.size()) });
+			try {
+				program.build({ device }, build_params.c_str());
+			}
+			catch(cl::Error&) {
+				return program;
+			}
+			if(!directory.empty())
+				store_program_binary(directory, cache_path, key, get_program_binary(program, device));
+			add_time(statistics.compiled_programs, statistics.compile_ms);
+			return program;
+		}
+	}
+
+	std::string get_device_key(cl::Device device) {
+		cl::Platform platform(device.getInfo<CL_DEVICE_PLATFORM>());
+		return platform.getInfo<CL_PLATFORM_NAME>() + "|" + platform.getInfo<CL_PLATFORM_VERSION>() + "|" +
+		       device.getInfo<CL_DEVICE_NAME>() + "|" + device.getInfo<CL_DEVICE_VERSION>() + "|" + device.getInfo<CL_DRIVER_VERSION>();
+	}
+
+	std::string load_kernel_source(const std::string& path) {
+		std::set<std::string> included;
+		std::string result;
+		append_kernel_source(path, included, result);
+		return result;
+	}
+
+	std::string resolve_kernel_includes(const std::string& source) {
+		std::set<std::string> included;
+		std::string result;
+		append_source_lines(source, included, result);
+		return result;
+	}
+
+	std::shared_future<cl::Program> build_cached_program_async(cl::Context ctx, cl::Device device, const std::string& source, const std::string& build_params) {
+		const auto key = get_device_key(device) + "|" + build_params + "|" + to_hex(hash_string(source));
+		const auto built_key = std::make_tuple(ctx(), device(), key);
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		for(auto built = built_programs.begin(); built != built_programs.end();) {
+			if(built->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				built = built_programs.erase(built);
+			else
+				++built;
+		}
+		auto built = built_programs.find(built_key);
+		if(built != built_programs.end())
+			return built->second;
+
+		auto pending = std::async(std::launch::async, build_program, ctx, device, source, build_params, key, program_cache_directory).share();
+		built_programs[built_key] = pending;
+		return pending;
+	}
+
+	void wait_for_program(const std::shared_future<cl::Program>& pending, cl::Device device, cl::Program& program) {
+		program = pending.get();
+		if(program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) != CL_BUILD_SUCCESS)
+			throw cl::Error(CL_BUILD_PROGRAM_FAILURE, "clBuildProgram");
+	}
+
+	void build_cached_program(cl::Context ctx, cl::Device device, const std::string& source, const std::string& build_params, cl::Program& program) {
+		wait_for_program(build_cached_program_async(ctx, device, source, build_params), device, program);
+	}
+
+	void set_program_cache_directory(const std::string& directory) {
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		program_cache_directory = directory;
+	}
+
+	Program_Cache_Statistics get_program_cache_statistics() {
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		return statistics;
+	}
+
+	void reset_program_cache_statistics() {
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		statistics = Program_Cache_Statistics{ 0, 0, 0.0, 0.0 };
+	}
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cl_libs.h>
+#include <string>
+#include <future>
+
+namespace sim {
+	// programs created since the last reset. the times are summed over all programs, concurrent builds overlap
+	struct Program_Cache_Statistics {
+		unsigned int compiled_programs;
+		unsigned int loaded_programs;
+		double compile_ms;
+		double load_ms;
+	};
+
+	// source of a kernel file with the includes of data/kernels resolved. the sources are embedded into the executable
+	// if it is compiled with EMBEDDED_KERNELS (see embed_kernels.py), otherwise they are read relative to the working directory
+	std::string load_kernel_source(const std::string& path);
+	// same for a generated source
+	std::string resolve_kernel_includes(const std::string& source);
+
+	// builds program from source for the device. the binaries are stored in the cache directory, keyed by device, driver version,
+	// source and build options (the process keeps no built programs, only the pending builds). program is assigned before
+	// an error is thrown, on a build error (cl::Error) its build log is available
+	void build_cached_program(cl::Context ctx, cl::Device device, const std::string& source, const std::string& build_params, cl::Program& program);
+	// same, the program is built on a worker thread. requests of a program which is still being built share the build
+	std::shared_future<cl::Program> build_cached_program_async(cl::Context ctx, cl::Device device, const std::string& source, const std::string& build_params);
+	// waits for an asynchronous build, error handling as build_cached_program
+	void wait_for_program(const std::shared_future<cl::Program>& pending, cl::Device device, cl::Program& program);
+
+	// platform, device and driver versions (identifies the device in the program cache and the tuning database)
+	std::string get_device_key(cl::Device device);
+
+	// directory of the program binaries (relative to the working directory), an empty path disables the disk cache
+	void set_program_cache_directory(const std::string& directory);
+	Program_Cache_Statistics get_program_cache_statistics();
+	void reset_program_cache_statistics();
+}
\ No newline at end of file
@@ -1,10 +1,43 @@
 #include "file_io.h"
 
 #include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 
 namespace utils {
 	std::string read_file(const std::string& path) {
 		std::ifstream file(path);
 		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
 	}
+
+	bool read_binary_file(const std::string& path, std::vector<unsigned char>& data) {
+		std::ifstream file(path, std::ios::binary);
+		if(!file)
+			return false;
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	bool write_binary_file(const std::string& path, const std::vector<unsigned char>& data) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if(!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return static_cast<bool>(file);
+	}
+
+	bool create_directory(const std::string& path) {
+#ifdef _WIN32
+		_mkdir(path.c_str());
+		struct _stat info;
+		return _stat(path.c_str(), &info) == 0 && (info.st_mode & _S_IFDIR);
+#else
+		mkdir(path.c_str(), 0755);
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+	}
 }
\ No newline at end of file
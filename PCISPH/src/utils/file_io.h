@@ -1,7 +1,13 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace utils {
 	std::string read_file(const std::string& path);
+	// binary files (read_binary_file returns false if the file doesn't exist)
+	bool read_binary_file(const std::string& path, std::vector<unsigned char>& data);
+	bool write_binary_file(const std::string& path, const std::vector<unsigned char>& data);
+	// creates a single directory, returns true if it exists afterwards
+	bool create_directory(const std::string& path);
 }
\ No newline at end of file
@@ -8,5 +8,13 @@ namespace vis {
 		gl::Buffer fluid_normals;
 		gl::Buffer fluid_densities;
 		gl::Buffer fluid_velocities;
+		// the simulation swaps positions / velocities with these buffers after sorting
+		gl::Buffer fluid_positions_back;
+		gl::Buffer fluid_velocities_back;
+
+		// buffer which currently holds the particle positions (sim::Fluid::are_particle_buffers_swapped)
+		const gl::Buffer& current_positions(bool swapped) const {
+			return swapped ? fluid_positions_back : fluid_positions;
+		}
 	};
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #pragma warning(pop)
 
 #include <memory>
+#include <string>
 
 namespace vis {
 	struct Data {
@@ -62,6 +63,11 @@ namespace vis {
 		data.reset();
 	}
 
+	void load_renderer_programs() {
+		get_cached_program("data/shaders/simple_particle.vert", "data/shaders/simple_particle.frag");
+		get_cached_program("data/shaders/boundary_cube.vert", "data/shaders/boundary_cube.frag");
+	}
+
 	void render_fluid_simple(const gl::Mat4f& trans, const sim::Fluid& fluid, const Fluid_Buffers& buffers) {
 		auto program = get_cached_program("data/shaders/simple_particle.vert", "data/shaders/simple_particle.frag");
 		program->Use();
@@ -72,13 +78,27 @@ namespace vis {
 		gl::Uniform<float>(*program, "color_factor_neutral").SetValue(fluid.get_params().rest_density);
 		gl::Uniform<float>(*program, "color_factor_max").SetValue(1.05f * fluid.get_params().rest_density);
 
-		buffers.fluid_positions.Bind(gl::Buffer::Target::Array);
-		auto particle_count = buffers.fluid_positions.Size(gl::Buffer::Target::Array) / (3 * sizeof(GLfloat));
-
-		(*program | "particle_pos")
-			.Setup<GLfloat>(3)
-			.Enable()
-			.Divisor(1);
+		const auto& positions = buffers.current_positions(fluid.are_particle_buffers_swapped());
+		positions.Bind(gl::Buffer::Target::Array);
+		// -> the buffers hold the capacity (SoA plane size), the active particles are at the front
+		auto particle_capacity = positions.Size(gl::Buffer::Target::Array) / fluid.get_particle_vec_size();
+		auto particle_count = fluid.get_params().fluid_count;
+
+		// -> one attribute per component to support all particle vector layouts.
+		// compressed positions are normalized 16 bit values: origin + scale * value
+		const auto& params = fluid.get_params();
+		const bool compressed = fluid.is_storage_compressed();
+		gl::Uniform<gl::Vec3f>(*program, "particle_pos_origin").SetValue(compressed ? gl::Vec3f(params.position_origin_x, params.position_origin_y, params.position_origin_z) : gl::Vec3f(0.f, 0.f, 0.f));
+		gl::Uniform<float>(*program, "particle_pos_scale").SetValue(compressed ? 65535.f / params.position_scale : 1.f);
+
+		const GLsizei particle_pos_stride = (GLsizei) (fluid.get_particle_vec_offset(particle_capacity, 1, 0) - fluid.get_particle_vec_offset(particle_capacity, 0, 0));
+		for(unsigned int c = 0; c < 3; c++) {
+			const std::string name = std::string("particle_pos_") + "xyz"[c];
+			(*program | name.c_str())
+				.Pointer(1, compressed ? gl::DataType::UnsignedShort : gl::DataType::Float, compressed, particle_pos_stride, (const void*) fluid.get_particle_vec_offset(particle_capacity, 0, c))
+				.Enable()
+				.Divisor(1);
+		}
 			
 		buffers.fluid_densities.Bind(gl::Buffer::Target::Array);
 		(*program | "color_factor")
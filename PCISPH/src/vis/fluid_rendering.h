@@ -8,6 +8,8 @@
 namespace vis {
 	void init_renderer();
 	void deinit_renderer();
+	// compiles the shader programs up front (otherwise on the first frame)
+	void load_renderer_programs();
 	void render_fluid_simple(const gl::Mat4f& trans, const sim::Fluid& fluid, const Fluid_Buffers& buffers);
 	void render_boundary_cubes(const gl::Mat4f& trans, const gl::Buffer& boundary_cubes, float boundary_cube_size);
 }
\ No newline at end of file